@@ -0,0 +1,117 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Compares HnswIndex with the exact scan over all the word vectors of a
+// model, reporting recall@k and the latency of a query for several ef.
+//
+// usage: benchmark-nn <model> [queries]
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "densematrix.h"
+#include "fasttext.h"
+#include "hnsw.h"
+#include "simd.h"
+#include "topk.h"
+
+using namespace fasttext;
+
+namespace {
+
+const int32_t K = 10;
+
+template <typename F>
+double microseconds(int64_t repeats, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t r = 0; r < repeats; r++) {
+    f(r);
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(end - start).count() /
+      repeats;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "usage: benchmark-nn <model> [queries]" << std::endl;
+    return 1;
+  }
+  FastText fasttext;
+  fasttext.loadModel(argv[1]);
+  auto dict = fasttext.getDictionary();
+  const int32_t nwords = dict->nwords();
+  const int32_t dim = fasttext.getDimension();
+  const int32_t nqueries =
+      std::min(argc > 2 ? std::stoi(argv[2]) : 1000, nwords);
+
+  DenseMatrix vectors(nwords, dim);
+  vectors.zero();
+  Vector vec(dim);
+  for (int32_t i = 0; i < nwords; i++) {
+    fasttext.getWordVector(vec, dict->getWord(i));
+    real norm = vec.norm();
+    if (norm > 0) {
+      vectors.addVectorToRow(vec, i, 1.0 / norm);
+    }
+  }
+  // Spread the queries over the vocabulary, which is sorted by frequency.
+  std::vector<Vector> queries;
+  for (int32_t q = 0; q < nqueries; q++) {
+    queries.emplace_back(dim);
+    fasttext.getWordVector(
+        queries.back(), dict->getWord(int64_t(q) * nwords / nqueries));
+  }
+
+  std::vector<real> scores(nwords);
+  TopK topk;
+  std::vector<std::vector<int32_t>> exact(nqueries);
+  double exactTime = microseconds(nqueries, [&](int64_t q) {
+    simd::gemv(
+        vectors.data(), nwords, dim, queries[q].data(), scores.data());
+    exact[q] = topk.select(scores.data(), nwords, K, -1e30);
+  });
+
+  HnswIndex index;
+  auto start = std::chrono::steady_clock::now();
+  index.build(vectors);
+  auto end = std::chrono::steady_clock::now();
+  std::cout << nwords << " words of dimension " << dim << ", index built in "
+            << std::fixed << std::setprecision(2)
+            << std::chrono::duration<double>(end - start).count() << "s"
+            << std::endl;
+
+  std::cout << std::setw(8) << "ef" << std::setw(12) << "recall@10"
+            << std::setw(12) << "time (us)" << std::setw(10) << "speedup"
+            << std::endl;
+  std::cout << std::setw(8) << "exact" << std::setw(12) << 1.0
+            << std::setw(12) << exactTime << std::setw(10) << "" << std::endl;
+  for (int32_t ef : {10, 20, 50, 100, 200, 400}) {
+    std::vector<std::vector<std::pair<real, int32_t>>> results(nqueries);
+    double time = microseconds(nqueries, [&](int64_t q) {
+      results[q] = index.search(queries[q], K, ef);
+    });
+    int64_t found = 0, total = 0;
+    for (int32_t q = 0; q < nqueries; q++) {
+      for (const auto& result : results[q]) {
+        found += std::count(exact[q].begin(), exact[q].end(), result.second);
+      }
+      total += exact[q].size();
+    }
+    std::cout << std::setw(8) << ef << std::setw(12)
+              << double(found) / std::max(total, int64_t(1)) << std::setw(12)
+              << time << std::setw(9) << exactTime / time << "x" << std::endl;
+  }
+  return 0;
+}
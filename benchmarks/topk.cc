@@ -0,0 +1,125 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+// Compares TopK with the heap based selection Loss::findKBest used before,
+// on softmax-like score vectors.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "topk.h"
+#include "utils.h"
+
+using namespace fasttext;
+
+namespace {
+
+real logScore(real x) {
+  return std::log(x + 1e-5);
+}
+
+bool comparePairs(
+    const std::pair<real, int32_t>& l,
+    const std::pair<real, int32_t>& r) {
+  return l.first > r.first;
+}
+
+void heapKBest(
+    int32_t k,
+    real threshold,
+    Predictions& heap,
+    const std::vector<real>& output) {
+  for (int32_t i = 0; i < output.size(); i++) {
+    if (output[i] < threshold) {
+      continue;
+    }
+    if (heap.size() == k && logScore(output[i]) < heap.front().first) {
+      continue;
+    }
+    heap.emplace_back(logScore(output[i]), i);
+    std::push_heap(heap.begin(), heap.end(), comparePairs);
+    if (heap.size() > k) {
+      std::pop_heap(heap.begin(), heap.end(), comparePairs);
+      heap.pop_back();
+    }
+  }
+  std::sort_heap(heap.begin(), heap.end(), comparePairs);
+}
+
+void topkKBest(
+    int32_t k,
+    real threshold,
+    Predictions& heap,
+    const std::vector<real>& output,
+    TopK& topk) {
+  for (int32_t i : topk.select(output.data(), output.size(), k, threshold)) {
+    heap.emplace_back(logScore(output[i]), i);
+  }
+}
+
+template <typename F>
+double microseconds(int64_t repeats, F f) {
+  auto start = std::chrono::steady_clock::now();
+  for (int64_t r = 0; r < repeats; r++) {
+    f();
+  }
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(end - start).count() /
+      repeats;
+}
+
+} // namespace
+
+int main() {
+  std::minstd_rand rng(1);
+  std::normal_distribution<real> normal(0.0, 2.0);
+  TopK topk;
+  Predictions heap;
+
+  std::cout << std::setw(8) << "nlabels" << std::setw(6) << "k"
+            << std::setw(12) << "heap (us)" << std::setw(12) << "topk (us)"
+            << std::setw(10) << "speedup" << std::endl;
+  for (int64_t n : {100, 10000, 1000000}) {
+    std::vector<real> output(n);
+    real z = 0.0;
+    for (auto& x : output) {
+      x = std::exp(normal(rng));
+      z += x;
+    }
+    for (auto& x : output) {
+      x /= z;
+    }
+    const int64_t repeats = std::max(int64_t(10), 20000000 / n);
+    for (int32_t k : {1, 5, 100}) {
+      double heapTime = microseconds(repeats, [&]() {
+        heap.clear();
+        heapKBest(k, 0.0, heap, output);
+      });
+      Predictions expected = heap;
+      double topkTime = microseconds(repeats, [&]() {
+        heap.clear();
+        topkKBest(k, 0.0, heap, output, topk);
+      });
+      if (heap.size() != expected.size()) {
+        std::cerr << "Selections differ for nlabels " << n << " and k " << k
+                  << std::endl;
+        return 1;
+      }
+      std::cout << std::setw(8) << n << std::setw(6) << k << std::setw(12)
+                << std::fixed << std::setprecision(2) << heapTime
+                << std::setw(12) << topkTime << std::setw(9)
+                << heapTime / topkTime << "x" << std::endl;
+    }
+  }
+  return 0;
+}
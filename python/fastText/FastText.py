@@ -14,6 +14,7 @@ import numpy as np
 import multiprocessing
 
 loss_name = fasttext.loss_name
+sampler_name = fasttext.sampler_name
 model_name = fasttext.model_name
 EOS = "</s>"
 BOW = "<"
@@ -31,10 +32,10 @@ class _FastText():
     strings are then encoded as UTF-8 and fed to the fastText C++ API.
     """
 
-    def __init__(self, model=None):
+    def __init__(self, model=None, mmap=False):
         self.f = fasttext.fasttext()
         if model is not None:
-            self.f.loadModel(model)
+            self.f.loadModel(model, mmap)
 
     def is_quantized(self):
         return self.f.isQuant()
@@ -97,6 +98,55 @@ class _FastText():
         self.f.getInputVector(b, ind)
         return np.array(b)
 
+    def get_nearest_neighbors(self, word, k=10, on_unicode_error='strict'):
+        """
+        Get the k words closest to word by cosine similarity, as a list of
+        (similarity, word) pairs, most similar first.
+
+        If given a list of words, it will return a list of results, one per
+        word, computed together much faster than one word at a time.
+        """
+        if type(word) == list:
+            return self.f.getNNBatch(word, k, on_unicode_error)
+        return self.f.getNN(word, k, on_unicode_error)
+
+    def get_analogies(
+        self, wordA, wordB, wordC, k=10, on_unicode_error='strict'
+    ):
+        """
+        Get the k words closest to wordA - wordB + wordC by cosine
+        similarity, as a list of (similarity, word) pairs, most similar
+        first.
+        """
+        return self.f.getAnalogies(wordA, wordB, wordC, k, on_unicode_error)
+
+    def set_nn_index(self, ef, path=""):
+        """
+        Make get_nearest_neighbors and get_analogies search an approximate
+        index keeping ef candidates per query instead of scanning every
+        word; 0 goes back to the exact scan. Larger ef are slower but miss
+        fewer of the exact neighbors. The index is built at the first query
+        and, if path is given, loaded from or saved to that file.
+        """
+        self.f.setNNIndex(ef, path)
+
+    def set_nn_threads(self, thread):
+        """
+        Set the number of threads computing the word vectors used by
+        get_nearest_neighbors and get_analogies, and scoring them when the
+        whole vocabulary is scanned.
+        """
+        self.f.setNNThreads(thread)
+
+    def set_word_vectors_cache(self, path):
+        """
+        Read the normalized word vectors used by get_nearest_neighbors and
+        get_analogies from path instead of computing them at the first
+        query. If path does not exist or was written for another model,
+        the vectors are computed and saved there.
+        """
+        self.f.setWordVectorsCache(path)
+
     def predict(self, text, k=1, threshold=0.0, on_unicode_error='strict'):
         """
         Given a string, get a list of labels and a list of
@@ -229,13 +279,21 @@ class _FastText():
             text = check(text)
             return self.f.getLine(text, on_unicode_error)
 
-    def save_model(self, path):
-        """Save the model to the given path"""
-        self.f.saveModel(path)
+    def save_model(self, path, aligned=False):
+        """
+        Save the model to the given path
 
-    def test(self, path, k=1):
-        """Evaluate supervised model using file given by path"""
-        return self.f.test(path, k)
+        If aligned is True, the model is saved in the aligned format, which
+        load_model can memory-map without copying the matrices.
+        """
+        self.f.saveModel(path, aligned)
+
+    def test(self, path, k=1, thread=1):
+        """
+        Evaluate supervised model using file given by path, predicting the
+        lines on the given number of threads
+        """
+        return self.f.test(path, k, thread)
 
     def test_label(self, path, k=1, threshold=0.0):
         """
@@ -309,13 +367,27 @@ def _parse_loss_string(string):
         return loss_name.softmax
     if string == "ova":
         return loss_name.ova
+    if string == "ssm":
+        return loss_name.ssm
     else:
         raise ValueError("Unrecognized loss name")
 
 
+def _parse_sampler_string(string):
+    if string == "table":
+        return sampler_name.table
+    if string == "alias":
+        return sampler_name.alias
+    if string == "loguniform":
+        return sampler_name.loguniform
+    else:
+        raise ValueError("Unrecognized sampler name")
+
+
 def _build_args(args):
     args["model"] = _parse_model_string(args["model"])
     args["loss"] = _parse_loss_string(args["loss"])
+    args["sampler"] = _parse_sampler_string(args["sampler"])
     a = fasttext.args()
     for (k, v) in args.items():
         setattr(a, k, v)
@@ -332,9 +404,14 @@ def tokenize(text):
     return f.tokenize(text)
 
 
-def load_model(path):
-    """Load a model given a filepath and return a model object."""
-    return _FastText(path)
+def load_model(path, mmap=False):
+    """
+    Load a model given a filepath and return a model object.
+
+    If mmap is True, the matrices are memory-mapped read-only instead of
+    copied, so processes loading the same file share its pages.
+    """
+    return _FastText(path, mmap)
 
 
 def train_supervised(
@@ -357,6 +434,11 @@ def train_supervised(
     label="__label__",
     verbose=2,
     pretrainedVectors="",
+    sampler="table",
+    sparseOva=False,
+    pinThreads=False,
+    vocabCapacity=0,
+    dictCache="",
 ):
     """
     Train a supervised model and return a model object.
@@ -398,6 +480,10 @@ def train_unsupervised(
     label="__label__",
     verbose=2,
     pretrainedVectors="",
+    sampler="table",
+    pinThreads=False,
+    vocabCapacity=0,
+    dictCache="",
 ):
     """
     Train an unsupervised model and return a model object.
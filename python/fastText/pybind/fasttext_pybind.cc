@@ -76,9 +76,14 @@ PYBIND11_MODULE(fasttext_pybind, m) {
       .def_readwrite("epoch", &fasttext::Args::epoch)
       .def_readwrite("minCount", &fasttext::Args::minCount)
       .def_readwrite("minCountLabel", &fasttext::Args::minCountLabel)
+      .def_readwrite("vocabCapacity", &fasttext::Args::vocabCapacity)
+      .def_readwrite("dictCache", &fasttext::Args::dictCache)
       .def_readwrite("neg", &fasttext::Args::neg)
       .def_readwrite("wordNgrams", &fasttext::Args::wordNgrams)
       .def_readwrite("loss", &fasttext::Args::loss)
+      .def_readwrite("sampler", &fasttext::Args::sampler)
+      .def_readwrite("sparseOva", &fasttext::Args::sparseOva)
+      .def_readwrite("pinThreads", &fasttext::Args::pinThreads)
       .def_readwrite("model", &fasttext::Args::model)
       .def_readwrite("bucket", &fasttext::Args::bucket)
       .def_readwrite("minn", &fasttext::Args::minn)
@@ -107,6 +112,13 @@ PYBIND11_MODULE(fasttext_pybind, m) {
       .value("ns", fasttext::loss_name::ns)
       .value("softmax", fasttext::loss_name::softmax)
       .value("ova", fasttext::loss_name::ova)
+      .value("ssm", fasttext::loss_name::ssm)
+      .export_values();
+
+  py::enum_<fasttext::sampler_name>(m, "sampler_name")
+      .value("table", fasttext::sampler_name::table)
+      .value("alias", fasttext::sampler_name::alias)
+      .value("loguniform", fasttext::sampler_name::loguniform)
       .export_values();
 
   m.def(
@@ -160,19 +172,26 @@ PYBIND11_MODULE(fasttext_pybind, m) {
           })
       .def(
           "loadModel",
-          [](fasttext::FastText& m, const std::string& s) { m.loadModel(s); })
+          [](fasttext::FastText& m, const std::string& s, bool mmap) {
+            m.loadModel(s, mmap);
+          })
       .def(
           "saveModel",
-          [](fasttext::FastText& m, const std::string& s) { m.saveModel(s); })
+          [](fasttext::FastText& m, const std::string& s, bool aligned) {
+            m.saveModel(s, aligned);
+          })
       .def(
           "test",
-          [](fasttext::FastText& m, const std::string& filename, int32_t k) {
+          [](fasttext::FastText& m,
+             const std::string& filename,
+             int32_t k,
+             int32_t nthreads) {
             std::ifstream ifs(filename);
             if (!ifs.is_open()) {
               throw std::invalid_argument("Test file cannot be opened!");
             }
             fasttext::Meter meter;
-            m.test(ifs, k, 0.0, meter);
+            m.test(ifs, k, 0.0, meter, nthreads);
             ifs.close();
             return std::tuple<int64_t, double, double>(
                 meter.nexamples(), meter.precision(), meter.recall());
@@ -441,6 +460,71 @@ PYBIND11_MODULE(fasttext_pybind, m) {
           [](fasttext::FastText& m,
              fasttext::Vector& vec,
              const std::string& word) { m.getWordVector(vec, word); })
+      .def(
+          "getNN",
+          [](fasttext::FastText& m,
+             const std::string& word,
+             int32_t k,
+             const char* onUnicodeError) {
+            std::vector<std::pair<fasttext::real, py::str>> results;
+            for (const auto& neighbor : m.getNN(word, k)) {
+              results.emplace_back(
+                  neighbor.first,
+                  castToPythonString(neighbor.second, onUnicodeError));
+            }
+            return results;
+          })
+      .def(
+          "getNNBatch",
+          [](fasttext::FastText& m,
+             const std::vector<std::string>& words,
+             int32_t k,
+             const char* onUnicodeError) {
+            std::vector<std::vector<std::pair<fasttext::real, py::str>>>
+                results;
+            results.reserve(words.size());
+            for (const auto& neighbors : m.getNNBatch(words, k)) {
+              results.emplace_back();
+              for (const auto& neighbor : neighbors) {
+                results.back().emplace_back(
+                    neighbor.first,
+                    castToPythonString(neighbor.second, onUnicodeError));
+              }
+            }
+            return results;
+          })
+      .def(
+          "getAnalogies",
+          [](fasttext::FastText& m,
+             const std::string& wordA,
+             const std::string& wordB,
+             const std::string& wordC,
+             int32_t k,
+             const char* onUnicodeError) {
+            std::vector<std::pair<fasttext::real, py::str>> results;
+            for (const auto& neighbor :
+                 m.getAnalogies(k, wordA, wordB, wordC)) {
+              results.emplace_back(
+                  neighbor.first,
+                  castToPythonString(neighbor.second, onUnicodeError));
+            }
+            return results;
+          })
+      .def(
+          "setNNIndex",
+          [](fasttext::FastText& m, int32_t ef, const std::string& path) {
+            m.setNNIndex(ef, path);
+          })
+      .def(
+          "setWordVectorsCache",
+          [](fasttext::FastText& m, const std::string& path) {
+            m.setWordVectorsCache(path);
+          })
+      .def(
+          "setNNThreads",
+          [](fasttext::FastText& m, int32_t nthreads) {
+            m.setNNThreads(nthreads);
+          })
       .def(
           "getSubwords",
           [](fasttext::FastText& m,
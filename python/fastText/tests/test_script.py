@@ -13,6 +13,7 @@ from fastText import train_supervised
 from fastText import train_unsupervised
 from fastText import util
 import fastText
+import multiprocessing
 import os
 import subprocess
 import unittest
@@ -228,6 +229,87 @@ class TestFastTextUnitPy(unittest.TestCase):
         # Need at least one word to have a label and a word to prevent error
         check(get_random_data(100, min_words_line=2))
 
+    def gen_test_supervised_parallel_vocab(self, kwargs):
+        # A file large enough to be counted on several threads gives the
+        # same vocabulary as on one thread.
+        data = get_random_data(1000, max_vocab_size=1000, min_words_line=1)
+        with tempfile.NamedTemporaryFile(delete=False) as tmpf:
+            while tmpf.tell() < 10 * 2**20:
+                for line in random.sample(data, len(data)):
+                    tmpf.write(("__label__" + line + "\n").encode("UTF-8"))
+            tmpf.flush()
+            f = train_supervised(input=tmpf.name, **default_kwargs(kwargs))
+            kwargs["thread"] = 4
+            g = train_supervised(input=tmpf.name, **kwargs)
+        for get in ["get_words", "get_labels"]:
+            entries1, freq1 = getattr(f, get)(include_freq=True)
+            entries2, freq2 = getattr(g, get)(include_freq=True)
+            self.assertEqual(entries1, entries2)
+            self.assertEqual(list(freq1), list(freq2))
+
+    def gen_test_supervised_test_threads(self, kwargs):
+        # Testing on several threads gives the same results as on one.
+        f = build_supervised_model(get_random_data(100), kwargs)
+        with tempfile.NamedTemporaryFile(delete=False) as tmpf:
+            for line in get_random_data(3000, min_words_line=2):
+                tmpf.write(("__label__" + line.strip() + "\n").encode("UTF-8"))
+            tmpf.flush()
+            self.assertEqual(f.test(tmpf.name), f.test(tmpf.name, thread=4))
+
+    def gen_test_supervised_hs_single_label(self, kwargs):
+        # A hierarchical softmax over a single label has no inner nodes.
+        kwargs["loss"] = "hs"
+        data = get_random_data(100, min_words_line=1)
+        f = build_supervised_model(["a " + line for line in data], kwargs)
+        labels, probs = f.predict(data[:10], k=2)
+        for label in labels:
+            self.assertEqual(list(label), ["__label__a"])
+
+    def gen_test_supervised_sampled_softmax(self, kwargs):
+        # A sampled softmax model is saved as a softmax one and predicts
+        # the same once loaded.
+        kwargs["loss"] = "ssm"
+        f = build_supervised_model(get_random_data(100), kwargs)
+        data = get_random_data(20)
+        labels, probs = f.predict(data, k=2)
+        path = os.path.join(tempfile.mkdtemp(), "model.bin")
+        f.save_model(path)
+        g = fastText.load_model(path)
+        self.assertEqual(
+            g.f.getArgs().loss, fastText.FastText.loss_name.softmax
+        )
+        labels2, probs2 = g.predict(data, k=2)
+        for label1, label2 in zip(labels, labels2):
+            self.assertEqual(list(label1), list(label2))
+        for prob1, prob2 in zip(probs, probs2):
+            self.assertEqual(list(prob1), list(prob2))
+
+    def gen_test_supervised_sparse_ova(self, kwargs):
+        # Lines whose labels are all the labels leave no negative to sample.
+        kwargs["loss"] = "ova"
+        kwargs["sparseOva"] = True
+        data = get_random_data(100, min_words_line=1)
+        f = build_supervised_model(
+            ["a __label__b " + line for line in data], kwargs
+        )
+        labels, probs = f.predict(data[:10], k=2)
+        for label in labels:
+            self.assertEqual(sorted(label), ["__label__a", "__label__b"])
+
+    def gen_test_supervised_pin_threads(self, kwargs):
+        # Training completes with more pinned threads than CPUs, which
+        # then share CPUs, and the model predicts known labels.
+        data = get_random_data(100)
+        kwargs["thread"] = multiprocessing.cpu_count() + 2
+        kwargs["pinThreads"] = True
+        f = build_supervised_model(data, kwargs)
+        labels = set(f.get_labels())
+        for line in data:
+            predicted, probs = f.predict(line, 2)
+            self.assertTrue(set(predicted).issubset(labels))
+            for prob in probs:
+                self.assertTrue(0.0 <= prob <= 1.0 + 1e-5)
+
     def gen_test_supervised_predict(self, kwargs):
         # Confirm number of labels, confirm labels for easy dataset
         # Confirm 1 label and 0 label dataset
@@ -241,6 +323,24 @@ class TestFastTextUnitPy(unittest.TestCase):
             for line in data:
                 labels, probs = f.predict(line, k)
 
+    def gen_test_supervised_predict_top_k(self, kwargs):
+        # The k best labels are the first k of all the labels, and a
+        # threshold only drops the labels below it.
+        data = get_random_data(100, min_words_line=2)
+        f = build_supervised_model(data, kwargs)
+        for line in data[:20]:
+            _, all_probs = f.predict(line, k=-1)
+            for k in [1, 2, 5]:
+                _, probs = f.predict(line, k)
+                self.assertEqual(list(probs), list(all_probs[:k]))
+            # probabilities are compared with a small smoothing, so the
+            # threshold is kept away from them
+            if len(all_probs) < 3 or all_probs[1] - all_probs[2] < 1e-3:
+                continue
+            threshold = (all_probs[1] + all_probs[2]) / 2
+            _, probs = f.predict(line, k=-1, threshold=threshold)
+            self.assertEqual(list(probs), list(all_probs[:2]))
+
     def gen_test_supervised_multiline_predict(self, kwargs):
         # Confirm number of labels, confirm labels for easy dataset
         # Confirm 1 label and 0 label dataset
@@ -315,6 +415,56 @@ class TestFastTextUnitPy(unittest.TestCase):
         for w in words:
             f.get_subwords(w)
 
+    def gen_test_supervised_words_reload(self, kwargs):
+        # Words, labels, their counts and ids survive saving and loading.
+        f = build_supervised_model(get_random_data(100), kwargs)
+        path = os.path.join(tempfile.mkdtemp(), "model.bin")
+        f.save_model(path)
+        g = fastText.load_model(path)
+        words1, freq1 = f.get_words(include_freq=True)
+        words2, freq2 = g.get_words(include_freq=True)
+        self.assertEqual(words1, words2)
+        self.assertEqual(list(freq1), list(freq2))
+        labels1, freq1 = f.get_labels(include_freq=True)
+        labels2, freq2 = g.get_labels(include_freq=True)
+        self.assertEqual(labels1, labels2)
+        self.assertEqual(list(freq1), list(freq2))
+        for word in words1 + get_random_words(20):
+            self.assertEqual(f.get_word_id(word), g.get_word_id(word))
+
+    def gen_test_subwords_reload(self, kwargs):
+        # The subword ids read back with a model are the ones it was
+        # trained with, for words in and out of the vocabulary.
+        f = build_unsupervised_model(get_random_data(100), kwargs)
+        path = os.path.join(tempfile.mkdtemp(), "model.bin")
+        f.save_model(path)
+        g = fastText.load_model(path)
+        for word in f.get_words() + get_random_words(20):
+            subwords1, ids1 = f.get_subwords(word)
+            subwords2, ids2 = g.get_subwords(word)
+            self.assertEqual(subwords1, subwords2)
+            self.assertEqual(list(ids1), list(ids2))
+            self.assertTrue(
+                np.array_equal(f.get_word_vector(word), g.get_word_vector(word))
+            )
+
+    def gen_test_training_delimiters(self, kwargs):
+        # Every whitespace and control delimiter separates the words of
+        # the training file like a space does.
+        data = get_random_data(100)
+        f = build_unsupervised_model(data, kwargs)
+        delimiters = [" ", "\t", "\v", "\f", "\r", "\0", "  \t"]
+        mixed = [
+            "".join(
+                word + random.choice(delimiters) for word in line.split(" ")
+            ) for line in data
+        ]
+        g = build_unsupervised_model(mixed, kwargs)
+        words1, freq1 = f.get_words(include_freq=True)
+        words2, freq2 = g.get_words(include_freq=True)
+        self.assertEqual(words1, words2)
+        self.assertEqual(list(freq1), list(freq2))
+
     def gen_test_tokenize(self, kwargs):
         self.assertEqual(["asdf", "asdb"], fastText.tokenize("asdf asdb"))
         self.assertEqual(["asdf"], fastText.tokenize("asdf"))
@@ -379,6 +529,132 @@ class TestFastTextUnitPy(unittest.TestCase):
             self.assertTrue(np.isclose(vec3, vec4, atol=1e-5, rtol=0).all())
             self.assertTrue(np.isclose(vec4, vec1, atol=1e-5, rtol=0).all())
 
+    def gen_test_unsupervised_sampler(self, kwargs):
+        # Every negative sampler trains a model over the same vocabulary.
+        data = get_random_data(100)
+        words = None
+        for sampler in ["table", "alias", "loguniform"]:
+            f = build_unsupervised_model(data, dict(kwargs, sampler=sampler))
+            if words is None:
+                words = f.get_words()
+            self.assertEqual(words, f.get_words())
+            for word in words:
+                self.assertTrue(np.all(np.isfinite(f.get_word_vector(word))))
+        gotError = False
+        try:
+            build_unsupervised_model(data, dict(kwargs, sampler="uniform"))
+        except ValueError:
+            gotError = True
+        self.assertTrue(gotError)
+
+    def gen_test_unsupervised_nn(self, kwargs):
+        # Neighbors are the other words by decreasing cosine similarity.
+        f = build_unsupervised_model(get_random_data(100), kwargs)
+        words = f.get_words()
+        vectors = np.array([f.get_word_vector(w) for w in words])
+        norms = np.linalg.norm(vectors, axis=1)
+        norms[norms < 1e-8] = 1
+        vectors /= norms[:, np.newaxis]
+        for i, word in enumerate(words[:10]):
+            neighbors = f.get_nearest_neighbors(word, k=5)
+            self.assertEqual(len(neighbors), min(5, len(words) - 1))
+            self.assertNotIn(word, [w for _, w in neighbors])
+            scores = [s for s, _ in neighbors]
+            self.assertEqual(scores, sorted(scores, reverse=True))
+            for score, neighbor in neighbors:
+                j = words.index(neighbor)
+                self.assertAlmostEqual(
+                    score, np.dot(vectors[i], vectors[j]), places=4
+                )
+
+    def gen_test_unsupervised_nn_batch(self, kwargs):
+        # A batch of queries gives the results of the queries one by one,
+        # repeated and unknown words included.
+        f = build_unsupervised_model(get_random_data(100), kwargs)
+        words = f.get_words()[:10]
+        words += words[:2] + get_random_words(2)
+        nearest = f.get_nearest_neighbors(words, k=5)
+        self.assertEqual(len(nearest), len(words))
+        for word, neighbors in zip(words, nearest):
+            self.assertEqual(neighbors, f.get_nearest_neighbors(word, k=5))
+
+    def gen_test_unsupervised_nn_threads_cache(self, kwargs):
+        # Word vectors computed on several threads or read from a cache
+        # give the same neighbors.
+        f = build_unsupervised_model(get_random_data(100), kwargs)
+        words = f.get_words()[:10]
+        nearest = f.get_nearest_neighbors(words, k=5)
+        tmpdir = tempfile.mkdtemp()
+        path = os.path.join(tmpdir, "model.bin")
+        cache_path = os.path.join(tmpdir, "model.wv")
+        f.save_model(path)
+        for _ in range(2):
+            g = fastText.load_model(path)
+            g.set_nn_threads(4)
+            g.set_word_vectors_cache(cache_path)
+            self.assertEqual(nearest, g.get_nearest_neighbors(words, k=5))
+            self.assertTrue(os.path.exists(cache_path))
+
+    def gen_test_unsupervised_nn_index(self, kwargs):
+        # Searches of a saved index match those of the index it was saved
+        # from, and a corrupted index file is rebuilt.
+        f = build_unsupervised_model(get_random_data(100), kwargs)
+        words = f.get_words()[:10]
+        path = os.path.join(tempfile.mkdtemp(), "model.hnsw")
+        f.set_nn_index(50, path)
+        nearest = f.get_nearest_neighbors(words, k=5)
+        for word, neighbors in zip(words, nearest):
+            self.assertEqual(len(neighbors), 5)
+            self.assertNotIn(word, [w for _, w in neighbors])
+            scores = [s for s, _ in neighbors]
+            self.assertEqual(scores, sorted(scores, reverse=True))
+        with open(path, "rb") as fid:
+            index = bytearray(fid.read())
+        for offset in [4, 36]:
+            corrupted = bytearray(index)
+            corrupted[offset:offset + 4] = b"\xff\xff\xff\x7f"
+            with open(path, "wb") as fid:
+                fid.write(corrupted)
+            f.set_nn_index(0)
+            f.set_nn_index(50, path)
+            self.assertEqual(nearest, f.get_nearest_neighbors(words, k=5))
+
+    def gen_test_unsupervised_vocab_capacity(self, kwargs):
+        # The words kept under a small -vocabCapacity have exact counts.
+        data = get_random_data(1000, max_vocab_size=1000)
+        f = build_unsupervised_model(data, kwargs)
+        words, freqs = f.get_words(include_freq=True)
+        exact = dict(zip(words, freqs))
+        kwargs["vocabCapacity"] = 200
+        g = build_unsupervised_model(data, kwargs)
+        words, freqs = g.get_words(include_freq=True)
+        self.assertTrue(len(words) > 0)
+        for word, freq in zip(words, freqs):
+            self.assertEqual(exact[word], freq)
+
+    def gen_test_unsupervised_dict_cache(self, kwargs):
+        # A cached dictionary gives the words of the input, and a truncated
+        # cache is rebuilt.
+        data = get_random_data(100)
+        words = build_unsupervised_model(data, kwargs).get_words()
+        path = os.path.join(tempfile.mkdtemp(), "dict.cache")
+        kwargs = default_kwargs(dict(kwargs, dictCache=path))
+        with tempfile.NamedTemporaryFile(delete=False) as tmpf:
+            for line in data:
+                tmpf.write((line + "\n").encode("UTF-8"))
+            tmpf.flush()
+            for _ in range(2):
+                f = train_unsupervised(input=tmpf.name, **kwargs)
+                self.assertEqual(words, f.get_words())
+            with open(path, "rb") as fid:
+                cache = fid.read()
+            with open(path, "wb") as fid:
+                fid.write(cache[:len(cache) // 2])
+            f = train_unsupervised(input=tmpf.name, **kwargs)
+            self.assertEqual(words, f.get_words())
+            with open(path, "rb") as fid:
+                self.assertEqual(cache, fid.read())
+
     def gen_test_unsupervised_get_words(self, kwargs):
         # Check more corner cases of 0 vocab, empty file etc.
         f = build_unsupervised_model(get_random_data(100), kwargs)
@@ -429,6 +705,46 @@ class TestFastTextUnitPy(unittest.TestCase):
         f.quantize()
         self.assertTrue(f.is_quantized())
 
+    def gen_test_supervised_aligned_model(self, kwargs):
+        # Models converted to the aligned format, loaded with or without
+        # mmap, predict exactly like the model they were converted from.
+        f = build_supervised_model(get_random_data(100), kwargs)
+        data = get_random_data(20)
+        labels, probs = f.predict(data, k=2)
+        tmpdir = tempfile.mkdtemp()
+        path = os.path.join(tmpdir, "model.bin")
+        aligned_path = os.path.join(tmpdir, "model_aligned.bin")
+        f.save_model(path)
+        fastText.load_model(path).save_model(aligned_path, aligned=True)
+        for model_path in [path, aligned_path]:
+            for mmap in [False, True]:
+                g = fastText.load_model(model_path, mmap=mmap)
+                self.assertEqual(f.get_words(), g.get_words())
+                labels2, probs2 = g.predict(data, k=2)
+                for label1, label2 in zip(labels, labels2):
+                    self.assertEqual(list(label1), list(label2))
+                for prob1, prob2 in zip(probs, probs2):
+                    self.assertEqual(list(prob1), list(prob2))
+
+    def gen_test_supervised_mmap_quantized(self, kwargs):
+        # A quantized model loaded with mmap predicts like the model it
+        # was saved from.
+        f = build_supervised_model(
+            get_random_data(1000, max_vocab_size=1000), kwargs
+        )
+        f.quantize()
+        data = get_random_data(20)
+        labels, probs = f.predict(data, k=2)
+        path = os.path.join(tempfile.mkdtemp(), "model.ftz")
+        f.save_model(path)
+        g = fastText.load_model(path, mmap=True)
+        self.assertTrue(g.is_quantized())
+        labels2, probs2 = g.predict(data, k=2)
+        for label1, label2 in zip(labels, labels2):
+            self.assertEqual(list(label1), list(label2))
+        for prob1, prob2 in zip(probs, probs2):
+            self.assertEqual(list(prob1), list(prob2))
+
     def gen_test_newline_predict_sentence(self, kwargs):
         f = build_supervised_model(get_random_data(100), kwargs)
         sentence = " ".join(get_random_words(20))
@@ -22,9 +22,12 @@ Args::Args() {
   epoch = 5;
   minCount = 5;
   minCountLabel = 0;
+  vocabCapacity = 0;
+  dictCache = "";
   neg = 5;
   wordNgrams = 1;
   loss = loss_name::ns;
+  sampler = sampler_name::table;
   model = model_name::sg;
   bucket = 2000000;
   minn = 3;
@@ -36,6 +39,8 @@ Args::Args() {
   verbose = 2;
   pretrainedVectors = "";
   saveOutput = false;
+  sparseOva = false;
+  pinThreads = false;
 
   qout = false;
   retrain = false;
@@ -54,10 +59,24 @@ std::string Args::lossToString(loss_name ln) const {
       return "softmax";
     case loss_name::ova:
       return "one-vs-all";
+    case loss_name::ssm:
+      return "sampled-softmax";
   }
   return "Unknown loss!"; // should never happen
 }
 
+std::string Args::samplerToString(sampler_name sn) const {
+  switch (sn) {
+    case sampler_name::table:
+      return "table";
+    case sampler_name::alias:
+      return "alias";
+    case sampler_name::loguniform:
+      return "loguniform";
+  }
+  return "Unknown sampler name!"; // should never happen
+}
+
 std::string Args::boolToString(bool b) const {
   if (b) {
     return "true";
@@ -119,6 +138,10 @@ void Args::parseArgs(const std::vector<std::string>& args) {
         minCount = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-minCountLabel") {
         minCountLabel = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-vocabCapacity") {
+        vocabCapacity = std::stoi(args.at(ai + 1));
+      } else if (args[ai] == "-dictCache") {
+        dictCache = std::string(args.at(ai + 1));
       } else if (args[ai] == "-neg") {
         neg = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-wordNgrams") {
@@ -133,11 +156,26 @@ void Args::parseArgs(const std::vector<std::string>& args) {
         } else if (
             args.at(ai + 1) == "one-vs-all" || args.at(ai + 1) == "ova") {
           loss = loss_name::ova;
+        } else if (
+            args.at(ai + 1) == "sampled-softmax" || args.at(ai + 1) == "ssm") {
+          loss = loss_name::ssm;
         } else {
           std::cerr << "Unknown loss: " << args.at(ai + 1) << std::endl;
           printHelp();
           exit(EXIT_FAILURE);
         }
+      } else if (args[ai] == "-sampler") {
+        if (args.at(ai + 1) == "table") {
+          sampler = sampler_name::table;
+        } else if (args.at(ai + 1) == "alias") {
+          sampler = sampler_name::alias;
+        } else if (args.at(ai + 1) == "loguniform") {
+          sampler = sampler_name::loguniform;
+        } else {
+          std::cerr << "Unknown sampler: " << args.at(ai + 1) << std::endl;
+          printHelp();
+          exit(EXIT_FAILURE);
+        }
       } else if (args[ai] == "-bucket") {
         bucket = std::stoi(args.at(ai + 1));
       } else if (args[ai] == "-minn") {
@@ -157,6 +195,12 @@ void Args::parseArgs(const std::vector<std::string>& args) {
       } else if (args[ai] == "-saveOutput") {
         saveOutput = true;
         ai--;
+      } else if (args[ai] == "-sparseOva") {
+        sparseOva = true;
+        ai--;
+      } else if (args[ai] == "-pinThreads") {
+        pinThreads = true;
+        ai--;
       } else if (args[ai] == "-qnorm") {
         qnorm = true;
         ai--;
@@ -212,6 +256,10 @@ void Args::printDictionaryHelp() {
             << minCount << "]\n"
             << "  -minCountLabel      minimal number of label occurences ["
             << minCountLabel << "]\n"
+            << "  -vocabCapacity      max number of distinct tokens counted at once, 0 to count them exactly ["
+            << vocabCapacity << "]\n"
+            << "  -dictCache          file where the dictionary of the input is kept for the next runs ["
+            << dictCache << "]\n"
             << "  -wordNgrams         max length of word ngram [" << wordNgrams
             << "]\n"
             << "  -bucket             number of buckets [" << bucket << "]\n"
@@ -233,9 +281,15 @@ void Args::printTrainingHelp() {
       << "  -ws                 size of the context window [" << ws << "]\n"
       << "  -epoch              number of epochs [" << epoch << "]\n"
       << "  -neg                number of negatives sampled [" << neg << "]\n"
-      << "  -loss               loss function {ns, hs, softmax, one-vs-all} ["
+      << "  -loss               loss function {ns, hs, softmax, one-vs-all, sampled-softmax} ["
       << lossToString(loss) << "]\n"
+      << "  -sampler            negative sampler {table, alias, loguniform} ["
+      << samplerToString(sampler) << "]\n"
+      << "  -sparseOva          whether one-vs-all only updates the positives and -neg sampled negatives ["
+      << boolToString(sparseOva) << "]\n"
       << "  -thread             number of threads [" << thread << "]\n"
+      << "  -pinThreads         whether training thread i only runs on the i-th allowed cpu ["
+      << boolToString(pinThreads) << "]\n"
       << "  -pretrainedVectors  pretrained word vectors for supervised learning ["
       << pretrainedVectors << "]\n"
       << "  -saveOutput         whether output params should be saved ["
@@ -263,7 +317,11 @@ void Args::save(std::ostream& out) {
   out.write((char*)&(minCount), sizeof(int));
   out.write((char*)&(neg), sizeof(int));
   out.write((char*)&(wordNgrams), sizeof(int));
-  out.write((char*)&(loss), sizeof(loss_name));
+  // a sampled softmax predicts with the full softmax, so it is saved as
+  // one to keep the model loadable by builds that do not know ssm
+  const loss_name savedLoss =
+      loss == loss_name::ssm ? loss_name::softmax : loss;
+  out.write((char*)&(savedLoss), sizeof(loss_name));
   out.write((char*)&(model), sizeof(model_name));
   out.write((char*)&(bucket), sizeof(int));
   out.write((char*)&(minn), sizeof(int));
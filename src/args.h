@@ -16,11 +16,13 @@
 namespace fasttext {
 
 enum class model_name : int { cbow = 1, sg, sup };
-enum class loss_name : int { hs = 1, ns, softmax, ova };
+enum class loss_name : int { hs = 1, ns, softmax, ova, ssm };
+enum class sampler_name : int { table = 1, alias, loguniform };
 
 class Args {
  protected:
   std::string lossToString(loss_name) const;
+  std::string samplerToString(sampler_name) const;
   std::string boolToString(bool) const;
   std::string modelToString(model_name) const;
 
@@ -35,9 +37,12 @@ class Args {
   int epoch;
   int minCount;
   int minCountLabel;
+  int vocabCapacity;
+  std::string dictCache;
   int neg;
   int wordNgrams;
   loss_name loss;
+  sampler_name sampler;
   model_name model;
   int bucket;
   int minn;
@@ -48,6 +53,8 @@ class Args {
   int verbose;
   std::string pretrainedVectors;
   bool saveOutput;
+  bool sparseOva;
+  bool pinThreads;
 
   bool qout;
   bool retrain;
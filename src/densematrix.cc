@@ -8,11 +8,15 @@
 
 #include "densematrix.h"
 
+#include <algorithm>
+#include <cmath>
 #include <exception>
 #include <random>
 #include <stdexcept>
+#include <thread>
 #include <utility>
 
+#include "simd.h"
 #include "utils.h"
 #include "vector.h"
 
@@ -29,11 +33,58 @@ void DenseMatrix::zero() {
   std::fill(data_.begin(), data_.end(), 0.0);
 }
 
-void DenseMatrix::uniform(real a) {
-  std::minstd_rand rng(1);
-  std::uniform_real_distribution<> uniform(-a, a);
-  for (int64_t i = 0; i < (m_ * n_); i++) {
-    data_[i] = uniform(rng);
+void DenseMatrix::resize(int64_t m, int64_t n) {
+  data_.resize(m * n);
+  m_ = m;
+  n_ = n;
+}
+
+namespace {
+
+// Draws of a double from std::minstd_rand, whose 31 bits are not enough
+// for one.
+const int64_t CALLS_PER_DRAW = 2;
+
+// State of a std::minstd_rand seeded with 1 after n calls, that is
+// multiplier^n mod modulus.
+uint64_t minstdState(int64_t n) {
+  uint64_t result = 1;
+  uint64_t base = std::minstd_rand::multiplier;
+  for (; n > 0; n >>= 1) {
+    if (n & 1) {
+      result = result * base % std::minstd_rand::modulus;
+    }
+    base = base * base % std::minstd_rand::modulus;
+  }
+  return result;
+}
+
+} // namespace
+
+// Every thread jumps its generator straight to the start of its slice, so
+// the values are those of a single generator seeded with 1 whatever the
+// number of threads.
+void DenseMatrix::uniform(real a, int32_t nthreads) {
+  const int64_t size = m_ * n_;
+  auto fill = [&](int64_t begin, int64_t end) {
+    std::minstd_rand rng(minstdState(begin * CALLS_PER_DRAW));
+    std::uniform_real_distribution<> uniform(-a, a);
+    for (int64_t i = begin; i < end; i++) {
+      data_[i] = uniform(rng);
+    }
+  };
+  nthreads = std::max(int64_t(1), std::min(int64_t(nthreads), m_));
+  if (nthreads == 1) {
+    fill(0, size);
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (int64_t t = 0; t < nthreads; t++) {
+    threads.push_back(std::thread(
+        fill, m_ * t / nthreads * n_, m_ * (t + 1) / nthreads * n_));
+  }
+  for (auto& thread : threads) {
+    thread.join();
   }
 }
 
@@ -89,41 +140,67 @@ real DenseMatrix::dotRow(const Vector& vec, int64_t i) const {
   assert(i >= 0);
   assert(i < m_);
   assert(vec.size() == n_);
-  real d = 0.0;
-  for (int64_t j = 0; j < n_; j++) {
-    d += at(i, j) * vec[j];
-  }
+  real d = simd::dot(data_.data() + i * n_, vec.data(), n_);
   if (std::isnan(d)) {
     throw std::runtime_error("Encountered NaN.");
   }
   return d;
 }
 
+void DenseMatrix::gemv(const Vector& x, Vector& y) const {
+  assert(x.size() == n_);
+  assert(y.size() == m_);
+  simd::gemv(data_.data(), m_, n_, x.data(), y.data());
+  checkNaN(y.data(), m_);
+}
+
+void DenseMatrix::gemm(const DenseMatrix& x, DenseMatrix& y) const {
+  assert(x.size(1) == n_);
+  assert(y.size(0) == x.size(0));
+  assert(y.size(1) == m_);
+  simd::gemm(data_.data(), m_, n_, x.data(), x.size(0), y.data());
+  checkNaN(y.data(), y.size(0) * m_);
+}
+
+void DenseMatrix::dotRows(
+    const Vector& x,
+    const int32_t* rows,
+    int64_t m,
+    real* out) const {
+  assert(x.size() == n_);
+  simd::dotRows(data_.data(), rows, m, n_, x.data(), out);
+}
+
 void DenseMatrix::addVectorToRow(const Vector& vec, int64_t i, real a) {
   assert(i >= 0);
   assert(i < m_);
   assert(vec.size() == n_);
-  for (int64_t j = 0; j < n_; j++) {
-    data_[i * n_ + j] += a * vec[j];
-  }
+  simd::axpy(a, vec.data(), data_.data() + i * n_, n_);
+}
+
+void DenseMatrix::updateRows(
+    const Vector& x,
+    const int32_t* rows,
+    const real* alpha,
+    int64_t m,
+    Vector& y) {
+  assert(x.size() == n_);
+  assert(y.size() == n_);
+  simd::updateRows(data_.data(), rows, alpha, m, n_, x.data(), y.data());
 }
 
 void DenseMatrix::addRowToVector(Vector& x, int32_t i) const {
   assert(i >= 0);
   assert(i < this->size(0));
   assert(x.size() == this->size(1));
-  for (int64_t j = 0; j < this->size(1); j++) {
-    x[j] += at(i, j);
-  }
+  simd::add(data_.data() + i * n_, x.data(), n_);
 }
 
 void DenseMatrix::addRowToVector(Vector& x, int32_t i, real a) const {
   assert(i >= 0);
   assert(i < this->size(0));
   assert(x.size() == this->size(1));
-  for (int64_t j = 0; j < this->size(1); j++) {
-    x[j] += a * at(i, j);
-  }
+  simd::axpy(a, data_.data() + i * n_, x.data(), n_);
 }
 
 void DenseMatrix::save(std::ostream& out) const {
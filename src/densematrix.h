@@ -56,7 +56,12 @@ class DenseMatrix : public Matrix {
     return n_;
   }
   void zero();
-  void uniform(real);
+  // Reshapes the matrix to m x n. The storage is only reallocated when it
+  // grows, and the values are left unspecified.
+  void resize(int64_t m, int64_t n);
+  // Fills the matrix with values drawn uniformly from [-a, a], on nthreads
+  // threads. The values do not depend on nthreads.
+  void uniform(real a, int32_t nthreads = 1);
 
   void multiplyRow(const Vector& nums, int64_t ib = 0, int64_t ie = -1);
   void divideRow(const Vector& denoms, int64_t ib = 0, int64_t ie = -1);
@@ -65,7 +70,17 @@ class DenseMatrix : public Matrix {
   void l2NormRow(Vector& norms) const;
 
   real dotRow(const Vector&, int64_t) const override final;
+  void gemv(const Vector& x, Vector& y) const override final;
+  void gemm(const DenseMatrix& x, DenseMatrix& y) const override final;
+  void dotRows(const Vector& x, const int32_t* rows, int64_t m, real* out)
+      const override final;
   void addVectorToRow(const Vector&, int64_t, real) override final;
+  void updateRows(
+      const Vector& x,
+      const int32_t* rows,
+      const real* alpha,
+      int64_t m,
+      Vector& y) override final;
   void addRowToVector(Vector& x, int32_t i) const override;
   void addRowToVector(Vector& x, int32_t i, real a) const override final;
   void save(std::ostream&) const override final;
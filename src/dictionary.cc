@@ -11,62 +11,181 @@
 #include <assert.h>
 
 #include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstring>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
 #include <iterator>
 #include <stdexcept>
+#include <thread>
+
+#include "utils.h"
 
 namespace fasttext {
 
+namespace {
+
+// Counts of the distinct tokens of one shard of a file, in the order of
+// their first occurrence.
+class TokenCounts {
+ protected:
+  // Open addressing over tokens, with a power of two number of slots.
+  std::vector<int32_t> slots_;
+
+  int64_t find(const char* w, size_t size, uint32_t h) const {
+    const int64_t mask = slots_.size() - 1;
+    int64_t slot = h & mask;
+    while (slots_[slot] != -1) {
+      const Token& t = tokens[slots_[slot]];
+      if (t.hash == h && size_t(t.size) == size &&
+          std::memcmp(strings.data() + t.offset, w, size) == 0) {
+        break;
+      }
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  void grow() {
+    slots_.assign(2 * slots_.size(), -1);
+    const int64_t mask = slots_.size() - 1;
+    for (size_t i = 0; i < tokens.size(); i++) {
+      int64_t slot = tokens[i].hash & mask;
+      while (slots_[slot] != -1) {
+        slot = (slot + 1) & mask;
+      }
+      slots_[slot] = i;
+    }
+  }
+
+ public:
+  struct Token {
+    int64_t offset;
+    int32_t size;
+    uint32_t hash;
+    int64_t count;
+  };
+
+  std::vector<Token> tokens;
+  std::vector<char> strings;
+  int64_t ntokens;
+
+  TokenCounts() : slots_(1 << 16, -1), ntokens(0) {}
+
+  void add(const char* w, size_t size, uint32_t h) {
+    ntokens++;
+    int64_t slot = find(w, size, h);
+    if (slots_[slot] != -1) {
+      tokens[slots_[slot]].count++;
+      return;
+    }
+    slots_[slot] = tokens.size();
+    tokens.push_back({int64_t(strings.size()), int32_t(size), h, 1});
+    strings.insert(strings.end(), w, w + size);
+    if (2 * tokens.size() > slots_.size()) {
+      grow();
+    }
+  }
+};
+
+} // namespace
+
 const std::string Dictionary::EOS = "</s>";
 const std::string Dictionary::BOW = "<";
 const std::string Dictionary::EOW = ">";
 
 Dictionary::Dictionary(std::shared_ptr<Args> args)
     : args_(args),
-      word2int_(MAX_VOCAB_SIZE, -1),
+      word2int_(
+          args->vocabCapacity > 0
+              ? std::min(
+                    int64_t(std::ceil(args->vocabCapacity / 0.7)),
+                    int64_t(MAX_VOCAB_SIZE))
+              : MAX_VOCAB_SIZE,
+          -1),
       size_(0),
       nwords_(0),
       nlabels_(0),
       ntokens_(0),
       pruneidx_size_(-1) {}
 
-Dictionary::Dictionary(std::shared_ptr<Args> args, std::istream& in)
+Dictionary::Dictionary(
+    std::shared_ptr<Args> args,
+    std::istream& in,
+    bool withTables)
     : args_(args),
       size_(0),
       nwords_(0),
       nlabels_(0),
       ntokens_(0),
       pruneidx_size_(-1) {
-  load(in);
+  if (withTables) {
+    loadEntries(in);
+    initTableDiscard();
+    loadTables(in);
+  } else {
+    load(in);
+  }
 }
 
 int32_t Dictionary::find(const std::string& w) const {
   return find(w, hash(w));
 }
 
+inline bool Dictionary::matches(
+    const entry& e,
+    const char* w,
+    size_t size,
+    uint32_t h) const {
+  return e.hash == h && size_t(e.size) == size &&
+      std::memcmp(strings_.data() + e.offset, w, size) == 0;
+}
+
 int32_t Dictionary::find(const std::string& w, uint32_t h) const {
+  return find(w.data(), w.size(), h);
+}
+
+int32_t Dictionary::find(const char* w, size_t size, uint32_t h) const {
   int32_t word2intsize = word2int_.size();
   int32_t id = h % word2intsize;
-  while (word2int_[id] != -1 && words_[word2int_[id]].word != w) {
+  while (word2int_[id] != -1 &&
+         !matches(words_[word2int_[id]], w, size, h)) {
+    id = (id + 1) % word2intsize;
+  }
+  return id;
+}
+
+// First free slot for a word that is known not to be in word2int_ yet.
+int32_t Dictionary::findSlot(uint32_t h, int32_t word2intsize) const {
+  int32_t id = h % word2intsize;
+  while (word2int_[id] != -1) {
     id = (id + 1) % word2intsize;
   }
   return id;
 }
 
 void Dictionary::add(const std::string& w) {
-  int32_t h = find(w);
-  ntokens_++;
+  add(w.data(), w.size(), hash(w));
+}
+
+void Dictionary::add(const char* w, size_t size, uint32_t hw, int64_t count) {
+  int32_t h = find(w, size, hw);
+  ntokens_ += count;
   if (word2int_[h] == -1) {
     entry e;
-    e.word = w;
-    e.count = 1;
-    e.type = getType(w);
+    e.count = count;
+    e.offset = strings_.size();
+    e.size = size;
+    e.hash = hw;
+    e.type = getType(w, size);
+    strings_.insert(strings_.end(), w, w + size);
+    strings_.push_back(0);
     words_.push_back(e);
     word2int_[h] = size_++;
   } else {
-    words_[word2int_[h]].count++;
+    words_[word2int_[h]].count += count;
   }
 }
 
@@ -82,17 +201,19 @@ int64_t Dictionary::ntokens() const {
   return ntokens_;
 }
 
-const std::vector<int32_t>& Dictionary::getSubwords(int32_t i) const {
+SubwordRange Dictionary::getSubwords(int32_t i) const {
   assert(i >= 0);
   assert(i < nwords_);
-  return words_[i].subwords;
+  const int32_t* ids = subwordIds_.data();
+  return SubwordRange(ids + subwordOffsets_[i], ids + subwordOffsets_[i + 1]);
 }
 
 const std::vector<int32_t> Dictionary::getSubwords(
     const std::string& word) const {
   int32_t i = getId(word);
   if (i >= 0) {
-    return getSubwords(i);
+    SubwordRange subwords = getSubwords(i);
+    return std::vector<int32_t>(subwords.begin(), subwords.end());
   }
   std::vector<int32_t> ngrams;
   if (word != EOS) {
@@ -101,6 +222,23 @@ const std::vector<int32_t> Dictionary::getSubwords(
   return ngrams;
 }
 
+void Dictionary::getSubwords(
+    const std::string& word,
+    std::vector<int32_t>& ngrams,
+    TokenScratch& scratch) const {
+  int32_t i = getId(word);
+  ngrams.clear();
+  if (i >= 0) {
+    SubwordRange subwords = getSubwords(i);
+    ngrams.assign(subwords.begin(), subwords.end());
+  } else if (word != EOS) {
+    scratch.bracketed.assign(BOW);
+    scratch.bracketed.append(word);
+    scratch.bracketed.append(EOW);
+    computeSubwords(scratch.bracketed, ngrams);
+  }
+}
+
 void Dictionary::getSubwords(
     const std::string& word,
     std::vector<int32_t>& ngrams,
@@ -110,7 +248,7 @@ void Dictionary::getSubwords(
   substrings.clear();
   if (i >= 0) {
     ngrams.push_back(i);
-    substrings.push_back(words_[i].word);
+    substrings.push_back(getWord(i));
   }
   if (word != EOS) {
     computeSubwords(BOW + word + EOW, ngrams, &substrings);
@@ -143,13 +281,26 @@ entry_type Dictionary::getType(int32_t id) const {
 }
 
 entry_type Dictionary::getType(const std::string& w) const {
-  return (w.find(args_->label) == 0) ? entry_type::label : entry_type::word;
+  return getType(w.data(), w.size());
+}
+
+entry_type Dictionary::getType(const char* w, size_t size) const {
+  const std::string& label = args_->label;
+  return size >= label.size() &&
+          std::memcmp(w, label.data(), label.size()) == 0
+      ? entry_type::label
+      : entry_type::word;
+}
+
+bool Dictionary::isEOS(const char* w, size_t size) const {
+  return size == EOS.size() && std::memcmp(w, EOS.data(), size) == 0;
 }
 
 std::string Dictionary::getWord(int32_t id) const {
   assert(id >= 0);
   assert(id < size_);
-  return words_[id].word;
+  const entry& e = words_[id];
+  return std::string(strings_.data() + e.offset, e.size);
 }
 
 // The correct implementation of fnv should be:
@@ -161,10 +312,9 @@ std::string Dictionary::getWord(int32_t id) const {
 // using signed char, we fixed the hash function to make models
 // compatible whatever compiler is used.
 uint32_t Dictionary::hash(const std::string& str) const {
-  uint32_t h = 2166136261u;
+  uint32_t h = FNV_OFFSET;
   for (auto x : str) {
-    h = h ^ uint32_t(int8_t(x)); // TODO: oops
-    h = h * 16777619u;
+    h = fnvStep(h, x);
   }
   return h;
 }
@@ -174,24 +324,23 @@ void Dictionary::computeSubwords(
     const std::string& word,
     std::vector<int32_t>& ngrams,
     std::vector<std::string>* substrings) const {
-
   ngrams.reserve(3ul * word.size());
   for (size_t i = 0; i < word.size(); i++) {
-    std::string ngram;
     if ((word[i] & 0xC0) == 0x80) {
       continue;
     }
 
+    // hash(ngram) computed incrementally as the ngram grows
+    uint32_t h = FNV_OFFSET;
     for (size_t j = i, n = 1; j < word.size() && n <= args_->maxn; n++) {
-      ngram.push_back(word[j++]);
+      h = fnvStep(h, word[j++]);
       while (j < word.size() && (word[j] & 0xC0) == 0x80) {
-        ngram.push_back(word[j++]);
+        h = fnvStep(h, word[j++]);
       }
       if (n >= args_->minn && !(n == 1 && (i == 0 || j == word.size()))) {
-        int32_t h = hash(ngram) % args_->bucket;
-        pushHash(ngrams, h);
+        pushHash(ngrams, h % args_->bucket);
         if (substrings) {
-          substrings->push_back(ngram);
+          substrings->push_back(word.substr(i, j - i));
         }
       }
     }
@@ -199,14 +348,19 @@ void Dictionary::computeSubwords(
 }
 
 void Dictionary::initNgrams() {
+  subwordOffsets_.clear();
+  subwordOffsets_.reserve(size_ + 1);
+  subwordOffsets_.push_back(0);
+  subwordIds_.clear();
   for (size_t i = 0; i < size_; i++) {
-    std::string word = BOW + words_[i].word + EOW;
-    words_[i].subwords.clear();
-    words_[i].subwords.push_back(i);
-    if (words_[i].word != EOS) {
-      computeSubwords(word, words_[i].subwords);
+    std::string word = getWord(i);
+    subwordIds_.push_back(i);
+    if (word != EOS) {
+      computeSubwords(BOW + word + EOW, subwordIds_);
     }
+    subwordOffsets_.push_back(subwordIds_.size());
   }
+  subwordIds_.shrink_to_fit();
 }
 
 bool Dictionary::readWord(std::istream& in, std::string& word) const {
@@ -235,11 +389,14 @@ bool Dictionary::readWord(std::istream& in, std::string& word) const {
   return !word.empty();
 }
 
-void Dictionary::readFromFile(std::istream& in) {
-  std::string word;
-  int64_t minThreshold = 1;
-  while (readWord(in, word)) {
-    add(word);
+// Adds the tokens one by one, pruning the rare words whenever the
+// vocabulary gets close to MAX_VOCAB_SIZE.
+void Dictionary::addTokens(Tokenizer& tokens, int64_t& minThreshold) {
+  const char* word;
+  size_t size;
+  uint32_t h;
+  while (tokens.next(word, size, h)) {
+    add(word, size, h);
     if (ntokens_ % 1000000 == 0 && args_->verbose > 1) {
       std::cerr << "\rRead " << ntokens_ / 1000000 << "M words" << std::flush;
     }
@@ -248,6 +405,100 @@ void Dictionary::readFromFile(std::istream& in) {
       threshold(minThreshold, minThreshold);
     }
   }
+}
+
+// Counts the tokens with at most -vocabCapacity distinct ones in the
+// dictionary. A word that is not in the dictionary has been seen at most
+// floor times, so a word added back after an eviction starts with that
+// error on its count, and the words seen more than floor times are never
+// evicted for good. As these counts can be too high, the file is then read
+// again to count the kept words exactly.
+void Dictionary::addTokensApproximately(Tokenizer& tokens) {
+  const int64_t capacity = std::min(
+      int64_t(args_->vocabCapacity), int64_t(0.75 * MAX_VOCAB_SIZE));
+  std::vector<int64_t> errors;
+  int64_t floor = 0;
+  const char* word;
+  size_t size;
+  uint32_t h;
+  while (tokens.next(word, size, h)) {
+    add(word, size, h);
+    if (int64_t(errors.size()) < size_) {
+      errors.push_back(floor);
+    }
+    if (ntokens_ % 1000000 == 0 && args_->verbose > 1) {
+      std::cerr << "\rRead " << ntokens_ / 1000000 << "M words" << std::flush;
+    }
+    if (size_ >= capacity) {
+      evictRareWords(errors, floor);
+    }
+  }
+  if (floor == 0) {
+    // nothing was evicted, the counts are exact
+    return;
+  }
+
+  std::vector<int64_t> approximate(size_);
+  for (int32_t i = 0; i < size_; i++) {
+    approximate[i] = words_[i].count + errors[i];
+    words_[i].count = 0;
+  }
+  tokens.rewind();
+  while (tokens.next(word, size, h)) {
+    const int32_t id = word2int_[find(word, size, h)];
+    if (id != -1) {
+      words_[id].count++;
+    }
+  }
+  int64_t inflated = 0;
+  int64_t maxError = 0;
+  int64_t totalError = 0;
+  for (int32_t i = 0; i < size_; i++) {
+    const int64_t error = approximate[i] - words_[i].count;
+    inflated += error > 0;
+    maxError = std::max(maxError, error);
+    totalError += error;
+  }
+  if (args_->verbose > 0) {
+    std::cerr << "\rApproximate counts: words seen up to " << floor
+              << " times may be missing, " << inflated << " of " << size_
+              << " counts were too high (by up to " << maxError
+              << ", on average " << double(totalError) / size_
+              << ") before the exact recount" << std::endl;
+  }
+}
+
+// Evicts the words whose counts, errors included, are in the lower half,
+// and raises floor to the largest of them. Labels are never evicted.
+void Dictionary::evictRareWords(std::vector<int64_t>& errors, int64_t& floor) {
+  std::vector<int64_t> counts;
+  for (int32_t i = 0; i < size_; i++) {
+    if (words_[i].type == entry_type::word) {
+      counts.push_back(words_[i].count + errors[i]);
+    }
+  }
+  if (int64_t(counts.size()) <= size_ / 2) {
+    throw std::invalid_argument(
+        "-vocabCapacity must be more than twice the number of labels.");
+  }
+  auto median = counts.begin() + counts.size() / 2;
+  std::nth_element(counts.begin(), median, counts.end());
+  floor = std::max(floor, *median);
+  int32_t j = 0;
+  for (int32_t i = 0; i < size_; i++) {
+    if (words_[i].type == entry_type::label ||
+        words_[i].count + errors[i] > *median) {
+      words_[j] = words_[i];
+      errors[j] = errors[i];
+      j++;
+    }
+  }
+  words_.resize(j);
+  errors.resize(j);
+  reindex();
+}
+
+void Dictionary::finishReading() {
   threshold(args_->minCount, args_->minCountLabel);
   initTableDiscard();
   initNgrams();
@@ -262,6 +513,124 @@ void Dictionary::readFromFile(std::istream& in) {
   }
 }
 
+void Dictionary::readFromFile(std::istream& in) {
+  Tokenizer tokens(in);
+  if (args_->vocabCapacity > 0) {
+    addTokensApproximately(tokens);
+  } else {
+    int64_t minThreshold = 1;
+    addTokens(tokens, minThreshold);
+  }
+  finishReading();
+}
+
+// Every thread counts the tokens of a contiguous shard of the file, cut
+// between two tokens. The shards are then added in order with their
+// counts, which gives the words in the order of their first occurrence,
+// and so the same dictionary as reading the whole file in one thread.
+// The pruning that keeps the vocabulary under MAX_VOCAB_SIZE depends on
+// the counts at the token where it happens, so a shard whose new words
+// could trigger it is added again token by token instead. A thread stops
+// counting once its shard has more distinct tokens than that, since the
+// shard is then read again anyway, which bounds the memory of the counts.
+void Dictionary::readFromFile(const std::string& filename, int32_t nthreads) {
+  std::ifstream in(filename);
+  if (!in.is_open()) {
+    throw std::invalid_argument(filename + " cannot be opened!");
+  }
+  const int64_t fileSize = utils::size(in);
+  nthreads = std::max(
+      int64_t(1),
+      std::min(int64_t(nthreads), fileSize / READ_MIN_BYTES_PER_THREAD));
+  // The thread local counts are not bounded, so approximate counting
+  // reads the file in one thread.
+  if (nthreads == 1 || args_->vocabCapacity > 0) {
+    utils::seek(in, 0);
+    readFromFile(in);
+    return;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<int64_t> bounds(1, 0);
+  for (int32_t t = 1; t < nthreads; t++) {
+    bounds.push_back(std::max(
+        bounds.back(), Tokenizer::boundary(in, t * fileSize / nthreads)));
+  }
+  bounds.push_back(fileSize);
+
+  std::vector<TokenCounts> counts(nthreads);
+  std::vector<char> overflowed(nthreads, false);
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < nthreads; t++) {
+    threads.push_back(std::thread([&, t]() {
+      std::ifstream shard(filename);
+      utils::seek(shard, bounds[t]);
+      Tokenizer tokens(shard, bounds[t + 1] - bounds[t]);
+      const char* word;
+      size_t size;
+      uint32_t h;
+      while (tokens.next(word, size, h)) {
+        counts[t].add(word, size, h);
+        if (counts[t].tokens.size() > 0.75 * MAX_VOCAB_SIZE) {
+          counts[t] = TokenCounts();
+          overflowed[t] = true;
+          break;
+        }
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  auto counted = std::chrono::steady_clock::now();
+
+  int64_t minThreshold = 1;
+  int32_t replayed = 0;
+  for (int32_t t = 0; t < nthreads; t++) {
+    const TokenCounts& shard = counts[t];
+    int64_t newWords = 0;
+    for (const auto& token : shard.tokens) {
+      const char* word = shard.strings.data() + token.offset;
+      if (word2int_[find(word, token.size, token.hash)] == -1) {
+        newWords++;
+      }
+    }
+    if (!overflowed[t] && size_ + newWords <= 0.75 * MAX_VOCAB_SIZE) {
+      for (const auto& token : shard.tokens) {
+        const char* word = shard.strings.data() + token.offset;
+        add(word, token.size, token.hash, token.count);
+      }
+    } else {
+      utils::seek(in, bounds[t]);
+      Tokenizer tokens(in, bounds[t + 1] - bounds[t]);
+      addTokens(tokens, minThreshold);
+      replayed++;
+    }
+    counts[t] = TokenCounts();
+    if (args_->verbose > 1) {
+      std::cerr << "\rRead " << ntokens_ / 1000000 << "M words" << std::flush;
+    }
+  }
+  auto merged = std::chrono::steady_clock::now();
+
+  if (args_->verbose > 0) {
+    const double countTime =
+        std::chrono::duration<double>(counted - start).count();
+    const double mergeTime =
+        std::chrono::duration<double>(merged - counted).count();
+    std::cerr << std::fixed << std::setprecision(2) << "\rCounted "
+              << fileSize / (1 << 20) << "MB in " << countTime << "s on "
+              << nthreads << " threads ("
+              << int64_t(ntokens_ / std::max(countTime, 1e-6) / nthreads)
+              << " words/sec/thread), merged in " << mergeTime << "s";
+    if (replayed > 0) {
+      std::cerr << ", " << replayed << " shard(s) read again for pruning";
+    }
+    std::cerr << std::defaultfloat << std::endl;
+  }
+  finishReading();
+}
+
 void Dictionary::threshold(int64_t t, int64_t tl) {
   sort(words_.begin(), words_.end(), [](const entry& e1, const entry& e2) {
     if (e1.type != e2.type) {
@@ -279,12 +648,18 @@ void Dictionary::threshold(int64_t t, int64_t tl) {
           }),
       words_.end());
   words_.shrink_to_fit();
+  reindex();
+}
+
+// Rebuilds word2int_ and the strings after words_ has changed.
+void Dictionary::reindex() {
   size_ = 0;
   nwords_ = 0;
   nlabels_ = 0;
+  compactStrings();
   std::fill(word2int_.begin(), word2int_.end(), -1);
   for (auto it = words_.begin(); it != words_.end(); ++it) {
-    int32_t h = find(it->word);
+    int32_t h = findSlot(it->hash, word2int_.size());
     word2int_[h] = size_++;
     if (it->type == entry_type::word) {
       nwords_++;
@@ -295,6 +670,19 @@ void Dictionary::threshold(int64_t t, int64_t tl) {
   }
 }
 
+// Drops the bytes of words that are no longer referenced by an entry.
+void Dictionary::compactStrings() {
+  std::vector<char> strings;
+  strings.reserve(strings_.size());
+  for (auto& e : words_) {
+    const char* word = strings_.data() + e.offset;
+    e.offset = strings.size();
+    strings.insert(strings.end(), word, word + e.size + 1);
+  }
+  strings.shrink_to_fit();
+  strings_.swap(strings);
+}
+
 void Dictionary::initTableDiscard() {
   pdiscard_.resize(size_);
   for (size_t i = 0; i < size_; i++) {
@@ -330,17 +718,22 @@ void Dictionary::addWordNgrams(
 
 void Dictionary::addSubwords(
     std::vector<int32_t>& line,
-    const std::string& token,
-    int32_t wid) const {
+    const char* token,
+    size_t size,
+    int32_t wid,
+    std::string& bracketed) const {
   if (wid < 0) { // out of vocab
-    if (token != EOS) {
-      computeSubwords(BOW + token + EOW, line);
+    if (!isEOS(token, size)) {
+      bracketed.assign(BOW);
+      bracketed.append(token, size);
+      bracketed.append(EOW);
+      computeSubwords(bracketed, line);
     }
   } else {
     if (args_->maxn <= 0) { // in vocab w/o subwords
       line.push_back(wid);
     } else { // in vocab w/ subwords
-      const std::vector<int32_t>& ngrams = getSubwords(wid);
+      SubwordRange ngrams = getSubwords(wid);
       line.insert(line.end(), ngrams.cbegin(), ngrams.cend());
     }
   }
@@ -353,28 +746,60 @@ void Dictionary::reset(std::istream& in) const {
   }
 }
 
+// Adds one token of a line read for unsupervised training, and returns
+// whether it ends the line.
+bool Dictionary::addToken(
+    const char* token,
+    size_t size,
+    uint32_t h,
+    std::vector<int32_t>& words,
+    std::minstd_rand& rng,
+    int32_t& ntokens) const {
+  std::uniform_real_distribution<> uniform(0, 1);
+  int32_t wid = word2int_[find(token, size, h)];
+  if (wid < 0) {
+    return false;
+  }
+
+  ntokens++;
+  if (getType(wid) == entry_type::word && !discard(wid, uniform(rng))) {
+    words.push_back(wid);
+  }
+  return ntokens > MAX_LINE_SIZE || isEOS(token, size);
+}
+
 int32_t Dictionary::getLine(
     std::istream& in,
     std::vector<int32_t>& words,
     std::minstd_rand& rng) const {
-  std::uniform_real_distribution<> uniform(0, 1);
   std::string token;
   int32_t ntokens = 0;
 
   reset(in);
   words.clear();
   while (readWord(in, token)) {
-    int32_t h = find(token);
-    int32_t wid = word2int_[h];
-    if (wid < 0) {
-      continue;
+    if (addToken(token.data(), token.size(), hash(token), words, rng, ntokens)) {
+      break;
     }
+  }
+  return ntokens;
+}
 
-    ntokens++;
-    if (getType(wid) == entry_type::word && !discard(wid, uniform(rng))) {
-      words.push_back(wid);
-    }
-    if (ntokens > MAX_LINE_SIZE || token == EOS) {
+int32_t Dictionary::getLine(
+    Tokenizer& tokens,
+    std::vector<int32_t>& words,
+    std::minstd_rand& rng) const {
+  const char* token;
+  size_t size;
+  uint32_t h;
+  int32_t ntokens = 0;
+
+  if (tokens.eof()) {
+    tokens.rewind();
+  }
+  words.clear();
+  while (tokens.next(token, size, h)) {
+    if (addToken(token, size, h, words, rng, ntokens)) {
       break;
     }
   }
@@ -385,30 +810,78 @@ int32_t Dictionary::getLine(
     std::istream& in,
     std::vector<int32_t>& words,
     std::vector<int32_t>& labels) const {
-  std::vector<int32_t> word_hashes;
-  std::string token;
+  TokenScratch scratch;
+  return getLine(in, words, labels, scratch);
+}
+
+// Adds one token of a line read for supervised training or prediction, and
+// returns whether it ends the line. The hashes of the words are collected
+// in scratch for the word n-grams.
+bool Dictionary::addToken(
+    const char* token,
+    size_t size,
+    uint32_t h,
+    std::vector<int32_t>& words,
+    std::vector<int32_t>& labels,
+    TokenScratch& scratch) const {
+  int32_t wid = word2int_[find(token, size, h)];
+  entry_type type = wid < 0 ? getType(token, size) : getType(wid);
+
+  if (type == entry_type::word) {
+    addSubwords(words, token, size, wid, scratch.bracketed);
+    scratch.hashes.push_back(h);
+  } else if (type == entry_type::label && wid >= 0) {
+    labels.push_back(wid - nwords_);
+  }
+  return isEOS(token, size);
+}
+
+int32_t Dictionary::getLine(
+    std::istream& in,
+    std::vector<int32_t>& words,
+    std::vector<int32_t>& labels,
+    TokenScratch& scratch) const {
+  std::string& token = scratch.token;
   int32_t ntokens = 0;
 
+  scratch.hashes.clear();
   reset(in);
   words.clear();
   labels.clear();
   while (readWord(in, token)) {
-    uint32_t h = hash(token);
-    int32_t wid = getId(token, h);
-    entry_type type = wid < 0 ? getType(token) : getType(wid);
-
     ntokens++;
-    if (type == entry_type::word) {
-      addSubwords(words, token, wid);
-      word_hashes.push_back(h);
-    } else if (type == entry_type::label && wid >= 0) {
-      labels.push_back(wid - nwords_);
+    if (addToken(
+            token.data(), token.size(), hash(token), words, labels, scratch)) {
+      break;
     }
-    if (token == EOS) {
+  }
+  addWordNgrams(words, scratch.hashes, args_->wordNgrams);
+  return ntokens;
+}
+
+int32_t Dictionary::getLine(
+    Tokenizer& tokens,
+    std::vector<int32_t>& words,
+    std::vector<int32_t>& labels,
+    TokenScratch& scratch) const {
+  const char* token;
+  size_t size;
+  uint32_t h;
+  int32_t ntokens = 0;
+
+  scratch.hashes.clear();
+  if (tokens.eof()) {
+    tokens.rewind();
+  }
+  words.clear();
+  labels.clear();
+  while (tokens.next(token, size, h)) {
+    ntokens++;
+    if (addToken(token, size, h, words, labels, scratch)) {
       break;
     }
   }
-  addWordNgrams(words, word_hashes, args_->wordNgrams);
+  addWordNgrams(words, scratch.hashes, args_->wordNgrams);
   return ntokens;
 }
 
@@ -431,7 +904,16 @@ std::string Dictionary::getLabel(int32_t lid) const {
     throw std::invalid_argument(
         "Label id is out of range [0, " + std::to_string(nlabels_) + "]");
   }
-  return words_[lid + nwords_].word;
+  return getWord(lid + nwords_);
+}
+
+void Dictionary::getLabel(int32_t lid, std::string& label) const {
+  if (lid < 0 || lid >= nlabels_) {
+    throw std::invalid_argument(
+        "Label id is out of range [0, " + std::to_string(nlabels_) + "]");
+  }
+  const entry& e = words_[lid + nwords_];
+  label.assign(strings_.data() + e.offset, e.size);
 }
 
 void Dictionary::save(std::ostream& out) const {
@@ -441,8 +923,8 @@ void Dictionary::save(std::ostream& out) const {
   out.write((char*)&ntokens_, sizeof(int64_t));
   out.write((char*)&pruneidx_size_, sizeof(int64_t));
   for (int32_t i = 0; i < size_; i++) {
-    entry e = words_[i];
-    out.write(e.word.data(), e.word.size() * sizeof(char));
+    const entry& e = words_[i];
+    out.write(strings_.data() + e.offset, e.size * sizeof(char));
     out.put(0);
     out.write((char*)&(e.count), sizeof(int64_t));
     out.write((char*)&(e.type), sizeof(entry_type));
@@ -453,19 +935,52 @@ void Dictionary::save(std::ostream& out) const {
   }
 }
 
-void Dictionary::load(std::istream& in) {
+void Dictionary::saveTables(std::ostream& out) const {
+  // The probe table is rebuilt at its load-time size: after training,
+  // word2int_ still has MAX_VOCAB_SIZE slots.
+  int32_t word2intsize = std::ceil(size_ / 0.7);
+  std::vector<int32_t> word2int(word2intsize, -1);
+  for (int32_t i = 0; i < size_; i++) {
+    int32_t id = words_[i].hash % word2intsize;
+    while (word2int[id] != -1) {
+      id = (id + 1) % word2intsize;
+    }
+    word2int[id] = i;
+  }
+  out.write((char*)&word2intsize, sizeof(int32_t));
+  out.write((char*)word2int.data(), word2intsize * sizeof(int32_t));
+
+  assert(subwordOffsets_.size() == size_t(size_ + 1));
+  out.write((char*)subwordOffsets_.data(), (size_ + 1) * sizeof(int64_t));
+  out.write(
+      (char*)subwordIds_.data(), subwordOffsets_[size_] * sizeof(int32_t));
+}
+
+void Dictionary::loadEntries(std::istream& in) {
   words_.clear();
+  strings_.clear();
   in.read((char*)&size_, sizeof(int32_t));
   in.read((char*)&nwords_, sizeof(int32_t));
   in.read((char*)&nlabels_, sizeof(int32_t));
   in.read((char*)&ntokens_, sizeof(int64_t));
   in.read((char*)&pruneidx_size_, sizeof(int64_t));
+  if (!in || nwords_ < 0 || nlabels_ < 0 || nwords_ + nlabels_ != size_) {
+    throw std::invalid_argument("Invalid model file.");
+  }
+  words_.reserve(size_);
   for (int32_t i = 0; i < size_; i++) {
-    char c;
+    int c;
     entry e;
+    e.offset = strings_.size();
     while ((c = in.get()) != 0) {
-      e.word.push_back(c);
+      if (c == std::istream::traits_type::eof()) {
+        throw std::invalid_argument("Invalid model file.");
+      }
+      strings_.push_back(c);
     }
+    e.size = strings_.size() - e.offset;
+    e.hash = hash(std::string(strings_.data() + e.offset, e.size));
+    strings_.push_back(0);
     in.read((char*)&e.count, sizeof(int64_t));
     in.read((char*)&e.type, sizeof(entry_type));
     words_.push_back(e);
@@ -478,16 +993,70 @@ void Dictionary::load(std::istream& in) {
     in.read((char*)&second, sizeof(int32_t));
     pruneidx_[first] = second;
   }
-  initTableDiscard();
-  initNgrams();
+}
+
+void Dictionary::loadTables(std::istream& in) {
+  int32_t word2intsize;
+  in.read((char*)&word2intsize, sizeof(int32_t));
+  if (!in || word2intsize < size_) {
+    throw std::invalid_argument("Invalid model file.");
+  }
+  word2int_.resize(word2intsize);
+  in.read((char*)word2int_.data(), word2intsize * sizeof(int32_t));
+  for (int32_t id : word2int_) {
+    if (id < -1 || id >= size_) {
+      throw std::invalid_argument("Invalid model file.");
+    }
+  }
+
+  subwordOffsets_.resize(size_ + 1);
+  in.read((char*)subwordOffsets_.data(), (size_ + 1) * sizeof(int64_t));
+  if (!in || subwordOffsets_[0] != 0) {
+    throw std::invalid_argument("Invalid model file.");
+  }
+  // An entry lists its own id and at most maxn subwords per character of
+  // BOW + word + EOW, which bounds the pool before it is allocated.
+  const int64_t maxPerChar = std::max(args_->maxn, 0);
+  for (int32_t i = 0; i < size_; i++) {
+    const int64_t count = subwordOffsets_[i + 1] - subwordOffsets_[i];
+    const int64_t chars = int64_t(words_[i].size) + 2;
+    if (count <= 0 || count > 1 + chars * maxPerChar) {
+      throw std::invalid_argument("Invalid model file.");
+    }
+  }
+  subwordIds_.resize(subwordOffsets_[size_]);
+  in.read((char*)subwordIds_.data(), subwordIds_.size() * sizeof(int32_t));
+  if (!in) {
+    throw std::invalid_argument("Invalid model file.");
+  }
+  // Every entry lists its own id, labels included, and the subwords of a
+  // word are rows of the input matrix after the words: the buckets, or
+  // the buckets kept by quantization.
+  const int64_t maxId = std::max(
+      int64_t(size_),
+      nwords_ + std::max(int64_t(args_->bucket), pruneidx_size_));
+  for (int32_t id : subwordIds_) {
+    if (id < 0 || id >= maxId) {
+      throw std::invalid_argument("Invalid model file.");
+    }
+  }
+}
 
+void Dictionary::initWord2Int() {
   int32_t word2intsize = std::ceil(size_ / 0.7);
   word2int_.assign(word2intsize, -1);
   for (int32_t i = 0; i < size_; i++) {
-    word2int_[find(words_[i].word)] = i;
+    word2int_[findSlot(words_[i].hash, word2intsize)] = i;
   }
 }
 
+void Dictionary::load(std::istream& in) {
+  loadEntries(in);
+  initTableDiscard();
+  initNgrams();
+  initWord2Int();
+}
+
 void Dictionary::init() {
   initTableDiscard();
   initNgrams();
@@ -524,23 +1093,25 @@ void Dictionary::prune(std::vector<int32_t>& idx) {
     if (getType(i) == entry_type::label ||
         (j < words.size() && words[j] == i)) {
       words_[j] = words_[i];
-      word2int_[find(words_[j].word)] = j;
+      word2int_[findSlot(words_[j].hash, word2int_.size())] = j;
       j++;
     }
   }
   nwords_ = words.size();
   size_ = nwords_ + nlabels_;
   words_.erase(words_.begin() + size_, words_.end());
+  compactStrings();
   initNgrams();
 }
 
 void Dictionary::dump(std::ostream& out) const {
   out << words_.size() << std::endl;
-  for (const auto& it : words_) {
+  for (int32_t i = 0; i < words_.size(); i++) {
+    const entry& it = words_[i];
     if (it.type == entry_type::label) {
-        out << it.word << " " << it.count << " " << "label" << std::endl;
+        out << getWord(i) << " " << it.count << " " << "label" << std::endl;
     } else {
-        out << it.word << " " << it.count << " " << "word" << std::endl;
+        out << getWord(i) << " " << it.count << " " << "word" << std::endl;
     }
   }
 }
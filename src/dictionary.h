@@ -18,35 +18,119 @@
 
 #include "args.h"
 #include "real.h"
+#include "tokenizer.h"
 
 namespace fasttext {
 
 typedef int32_t id_type;
 enum class entry_type : int8_t { word = 0, label = 1 };
 
+// The bytes of the word live in the string arena of the dictionary, and its
+// hash is kept so that probes and rebuilds of the table need not rehash it.
 struct entry {
-  std::string word;
   int64_t count;
+  int64_t offset;
+  int32_t size;
+  uint32_t hash;
   entry_type type;
-  std::vector<int32_t> subwords;
+};
+
+// Subword ids of one entry: a view into the flattened pool of the
+// dictionary, valid until the dictionary is modified.
+class SubwordRange {
+ protected:
+  const int32_t* begin_;
+  const int32_t* end_;
+
+ public:
+  SubwordRange(const int32_t* begin, const int32_t* end)
+      : begin_(begin), end_(end) {}
+
+  inline const int32_t* begin() const {
+    return begin_;
+  }
+  inline const int32_t* end() const {
+    return end_;
+  }
+  inline const int32_t* cbegin() const {
+    return begin_;
+  }
+  inline const int32_t* cend() const {
+    return end_;
+  }
+  inline size_t size() const {
+    return end_ - begin_;
+  }
+  inline int32_t operator[](size_t i) const {
+    return begin_[i];
+  }
+};
+
+// Reusable buffers for getLine() and getSubwords(), so that callers that
+// process many lines do not allocate per token.
+struct TokenScratch {
+  std::string token;
+  std::string bracketed;
+  std::vector<int32_t> hashes;
 };
 
 class Dictionary {
  protected:
   static const int32_t MAX_VOCAB_SIZE = 30000000;
   static const int32_t MAX_LINE_SIZE = 1024;
+  static const int64_t READ_MIN_BYTES_PER_THREAD = 1 << 22;
 
   int32_t find(const std::string&) const;
   int32_t find(const std::string&, uint32_t h) const;
+  int32_t find(const char* w, size_t size, uint32_t h) const;
+  int32_t findSlot(uint32_t h, int32_t word2intsize) const;
+  bool matches(const entry&, const char* w, size_t size, uint32_t h) const;
+  bool isEOS(const char* w, size_t size) const;
+  entry_type getType(const char* w, size_t size) const;
+  void add(const char* w, size_t size, uint32_t h, int64_t count = 1);
+  void addTokens(Tokenizer&, int64_t& minThreshold);
+  void addTokensApproximately(Tokenizer&);
+  void evictRareWords(std::vector<int64_t>& errors, int64_t& floor);
+  void reindex();
+  void finishReading();
+  void compactStrings();
   void initTableDiscard();
   void initNgrams();
+  void initWord2Int();
+  void loadEntries(std::istream&);
+  void loadTables(std::istream&);
   void reset(std::istream&) const;
   void pushHash(std::vector<int32_t>&, int32_t) const;
-  void addSubwords(std::vector<int32_t>&, const std::string&, int32_t) const;
+  void addSubwords(
+      std::vector<int32_t>&,
+      const char* token,
+      size_t size,
+      int32_t,
+      std::string& bracketed) const;
+  bool addToken(
+      const char* token,
+      size_t size,
+      uint32_t h,
+      std::vector<int32_t>& words,
+      std::vector<int32_t>& labels,
+      TokenScratch& scratch) const;
+  bool addToken(
+      const char* token,
+      size_t size,
+      uint32_t h,
+      std::vector<int32_t>& words,
+      std::minstd_rand& rng,
+      int32_t& ntokens) const;
 
   std::shared_ptr<Args> args_;
   std::vector<int32_t> word2int_;
   std::vector<entry> words_;
+  // NUL-separated bytes of all words, indexed by entry::offset.
+  std::vector<char> strings_;
+  // Subword ids of entry i are subwordIds_[subwordOffsets_[i]] up to
+  // subwordIds_[subwordOffsets_[i + 1]].
+  std::vector<int64_t> subwordOffsets_;
+  std::vector<int32_t> subwordIds_;
 
   std::vector<real> pdiscard_;
   int32_t size_;
@@ -67,7 +151,12 @@ class Dictionary {
   static const std::string EOW;
 
   explicit Dictionary(std::shared_ptr<Args>);
-  explicit Dictionary(std::shared_ptr<Args>, std::istream&);
+  // If withTables is set, the entries are followed by the lookup tables
+  // written by saveTables() and these are read instead of being rebuilt.
+  explicit Dictionary(
+      std::shared_ptr<Args>,
+      std::istream&,
+      bool withTables = false);
   int32_t nwords() const;
   int32_t nlabels() const;
   int64_t ntokens() const;
@@ -77,12 +166,14 @@ class Dictionary {
   entry_type getType(const std::string&) const;
   bool discard(int32_t, real) const;
   std::string getWord(int32_t) const;
-  const std::vector<int32_t>& getSubwords(int32_t) const;
+  SubwordRange getSubwords(int32_t) const;
   const std::vector<int32_t> getSubwords(const std::string&) const;
   void getSubwords(
       const std::string&,
       std::vector<int32_t>&,
       std::vector<std::string>&) const;
+  void getSubwords(const std::string&, std::vector<int32_t>&, TokenScratch&)
+      const;
   void computeSubwords(
       const std::string&,
       std::vector<int32_t>&,
@@ -91,14 +182,32 @@ class Dictionary {
   void add(const std::string&);
   bool readWord(std::istream&, std::string&) const;
   void readFromFile(std::istream&);
+  // Same as readFromFile(std::istream&) on the file, with the tokens
+  // counted by nthreads threads.
+  void readFromFile(const std::string& filename, int32_t nthreads);
   std::string getLabel(int32_t) const;
+  void getLabel(int32_t, std::string&) const;
   void save(std::ostream&) const;
+  void saveTables(std::ostream&) const;
   void load(std::istream&);
   std::vector<int64_t> getCounts(entry_type) const;
   int32_t getLine(std::istream&, std::vector<int32_t>&, std::vector<int32_t>&)
       const;
+  int32_t getLine(
+      std::istream&,
+      std::vector<int32_t>&,
+      std::vector<int32_t>&,
+      TokenScratch&) const;
   int32_t getLine(std::istream&, std::vector<int32_t>&, std::minstd_rand&)
       const;
+  // Same as the std::istream versions, for callers that read a whole
+  // stream line after line.
+  int32_t getLine(
+      Tokenizer&,
+      std::vector<int32_t>&,
+      std::vector<int32_t>&,
+      TokenScratch&) const;
+  int32_t getLine(Tokenizer&, std::vector<int32_t>&, std::minstd_rand&) const;
   void threshold(int64_t, int64_t);
   void prune(std::vector<int32_t>&);
   bool isPruned() {
@@ -8,11 +8,17 @@
 
 #include "fasttext.h"
 #include "loss.h"
+#include "mappedmatrix.h"
 #include "quantmatrix.h"
+#include "simd.h"
 
 #include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstring>
 #include <iomanip>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <sstream>
 #include <stdexcept>
@@ -20,10 +26,31 @@
 #include <thread>
 #include <vector>
 
+#include <sys/stat.h>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
 namespace fasttext {
 
 constexpr int32_t FASTTEXT_VERSION = 12; /* Version 1b */
+constexpr int32_t FASTTEXT_ALIGNED_VERSION = 13;
 constexpr int32_t FASTTEXT_FILEFORMAT_MAGIC_INT32 = 793712314;
+constexpr int32_t FASTTEXT_SECTION_ALIGNMENT = 64;
+
+// The aligned format starts with magic, version, the number of sections,
+// the alignment and a table of ModelSection. Each section is placed so that
+// its payload (the row data for dense matrices) starts on an aligned offset.
+enum class model_section : int32_t { args = 1, dictionary, input, output };
+
+struct ModelSection {
+  model_section id;
+  int32_t quant;
+  int64_t offset;
+  int64_t size;
+};
 
 bool comparePairs(
     const std::pair<real, std::string>& l,
@@ -37,17 +64,36 @@ std::shared_ptr<Loss> FastText::createLoss(std::shared_ptr<Matrix>& output) {
           output, getTargetCounts());
     case loss_name::ns:
       return std::make_shared<NegativeSamplingLoss>(
-          output, args_->neg, getTargetCounts());
+          output, args_->neg, args_->sampler, getTargetCounts());
     case loss_name::softmax:
       return std::make_shared<SoftmaxLoss>(output);
     case loss_name::ova:
-      return std::make_shared<OneVsAllLoss>(output);
+      return std::make_shared<OneVsAllLoss>(
+          output,
+          args_->sparseOva ? args_->neg : 0,
+          args_->sampler,
+          getTargetCounts());
+    case loss_name::ssm:
+      return std::make_shared<SampledSoftmaxLoss>(
+          output, args_->neg, args_->sampler, getTargetCounts());
     default:
       throw std::runtime_error("Unknown loss");
   }
 }
 
-FastText::FastText() : quant_(false), wordVectors_(nullptr) {}
+FastText::FastText()
+    : quant_(false),
+      wordVectors_(nullptr),
+      nnIndex_(nullptr),
+      nnEf_(0),
+      nnThreads_(1) {}
+
+InferenceContext::InferenceContext(const FastText& fasttext)
+    : state(
+          fasttext.getDimension(),
+          fasttext.getDictionary()->nlabels(),
+          0),
+      vec(fasttext.getDimension()) {}
 
 void FastText::addInputVector(Vector& vec, int32_t ind) const {
   vec.addRow(*input_, ind);
@@ -66,7 +112,12 @@ std::shared_ptr<const DenseMatrix> FastText::getInputMatrix() const {
     throw std::runtime_error("Can't export quantized matrix");
   }
   assert(input_.get());
-  return std::dynamic_pointer_cast<DenseMatrix>(input_);
+  std::shared_ptr<DenseMatrix> input =
+      std::dynamic_pointer_cast<DenseMatrix>(input_);
+  if (!input) {
+    throw std::runtime_error("Can't export memory-mapped matrix");
+  }
+  return input;
 }
 
 std::shared_ptr<const DenseMatrix> FastText::getOutputMatrix() const {
@@ -74,7 +125,12 @@ std::shared_ptr<const DenseMatrix> FastText::getOutputMatrix() const {
     throw std::runtime_error("Can't export quantized matrix");
   }
   assert(output_.get());
-  return std::dynamic_pointer_cast<DenseMatrix>(output_);
+  std::shared_ptr<DenseMatrix> output =
+      std::dynamic_pointer_cast<DenseMatrix>(output_);
+  if (!output) {
+    throw std::runtime_error("Can't export memory-mapped matrix");
+  }
+  return output;
 }
 
 int32_t FastText::getWordId(const std::string& word) const {
@@ -163,15 +219,14 @@ bool FastText::checkModel(std::istream& in) {
     return false;
   }
   in.read((char*)&(version), sizeof(int32_t));
-  if (version > FASTTEXT_VERSION) {
+  if (version > FASTTEXT_ALIGNED_VERSION) {
     return false;
   }
   return true;
 }
 
-void FastText::signModel(std::ostream& out) {
+void FastText::signModel(std::ostream& out, int32_t version) {
   const int32_t magic = FASTTEXT_FILEFORMAT_MAGIC_INT32;
-  const int32_t version = FASTTEXT_VERSION;
   out.write((char*)&(magic), sizeof(int32_t));
   out.write((char*)&(version), sizeof(int32_t));
 }
@@ -191,7 +246,7 @@ void FastText::saveModel(const std::string& filename) {
   if (!ofs.is_open()) {
     throw std::invalid_argument(filename + " cannot be opened for saving!");
   }
-  signModel(ofs);
+  signModel(ofs, FASTTEXT_VERSION);
   args_->save(ofs);
   dict_->save(ofs);
 
@@ -204,6 +259,74 @@ void FastText::saveModel(const std::string& filename) {
   ofs.close();
 }
 
+void FastText::saveModel(const std::string& filename, bool aligned) {
+  if (!aligned) {
+    saveModel(filename);
+    return;
+  }
+  std::ofstream ofs(filename, std::ofstream::binary);
+  if (!ofs.is_open()) {
+    throw std::invalid_argument(filename + " cannot be opened for saving!");
+  }
+  saveAlignedModel(ofs);
+  ofs.close();
+}
+
+void FastText::saveAlignedModel(std::ostream& out) {
+  signModel(out, FASTTEXT_ALIGNED_VERSION);
+  const int32_t nsections = 4;
+  const int32_t alignment = FASTTEXT_SECTION_ALIGNMENT;
+  out.write((char*)&nsections, sizeof(int32_t));
+  out.write((char*)&alignment, sizeof(int32_t));
+  int64_t tableOffset = out.tellp();
+  std::vector<ModelSection> sections(nsections);
+  out.write((char*)sections.data(), nsections * sizeof(ModelSection));
+
+  // headerSize bytes precede the aligned payload of the section.
+  auto beginSection = [&](ModelSection& section,
+                          model_section id,
+                          bool quant,
+                          int64_t headerSize) {
+    int64_t pos = out.tellp();
+    int64_t padding = (alignment - (pos + headerSize) % alignment) % alignment;
+    for (int64_t i = 0; i < padding; i++) {
+      out.put(0);
+    }
+    section.id = id;
+    section.quant = quant;
+    section.offset = pos + padding;
+  };
+  auto endSection = [&](ModelSection& section) {
+    section.size = int64_t(out.tellp()) - section.offset;
+  };
+  // rows of dense matrices follow their two int64 dimensions
+  const int64_t denseHeaderSize = 2 * sizeof(int64_t);
+
+  beginSection(sections[0], model_section::args, false, 0);
+  args_->save(out);
+  endSection(sections[0]);
+
+  beginSection(sections[1], model_section::dictionary, false, 0);
+  dict_->save(out);
+  dict_->saveTables(out);
+  endSection(sections[1]);
+
+  beginSection(
+      sections[2], model_section::input, quant_, quant_ ? 0 : denseHeaderSize);
+  input_->save(out);
+  endSection(sections[2]);
+
+  bool qout = quant_ && args_->qout;
+  beginSection(
+      sections[3], model_section::output, qout, qout ? 0 : denseHeaderSize);
+  output_->save(out);
+  endSection(sections[3]);
+
+  out.seekp(tableOffset);
+  out.write((char*)sections.data(), nsections * sizeof(ModelSection));
+  out.seekp(0, std::ios_base::end);
+}
+
 void FastText::loadModel(const std::string& filename) {
   std::ifstream ifs(filename, std::ifstream::binary);
   if (!ifs.is_open()) {
@@ -216,6 +339,20 @@ void FastText::loadModel(const std::string& filename) {
   ifs.close();
 }
 
+void FastText::loadModel(const std::string& filename, bool mmap) {
+  if (!mmap) {
+    loadModel(filename);
+    return;
+  }
+  auto map = std::make_shared<const MemoryMap>(filename);
+  MemoryMapBuffer buffer(*map);
+  std::istream in(&buffer);
+  if (!checkModel(in)) {
+    throw std::invalid_argument(filename + " has wrong file format!");
+  }
+  loadModel(in, map);
+}
+
 std::vector<int64_t> FastText::getTargetCounts() const {
   if (args_->model == model_name::sup) {
     return dict_->getCounts(entry_type::label);
@@ -225,42 +362,98 @@ std::vector<int64_t> FastText::getTargetCounts() const {
 }
 
 void FastText::loadModel(std::istream& in) {
+  loadModel(in, nullptr);
+}
+
+void FastText::loadModel(
+    std::istream& in,
+    std::shared_ptr<const MemoryMap> map) {
   args_ = std::make_shared<Args>();
-  input_ = std::make_shared<DenseMatrix>();
-  output_ = std::make_shared<DenseMatrix>();
-  args_->load(in);
-  if (version == 11 && args_->model == model_name::sup) {
-    // backward compatibility: old supervised models do not use char ngrams.
-    args_->maxn = 0;
-  }
-  dict_ = std::make_shared<Dictionary>(args_, in);
+  wordVectors_.reset();
+  nnIndex_.reset();
+  if (version == FASTTEXT_ALIGNED_VERSION) {
+    loadAlignedModel(in, map);
+  } else {
+    args_->load(in);
+    if (version == 11 && args_->model == model_name::sup) {
+      // backward compatibility: old supervised models do not use char ngrams.
+      args_->maxn = 0;
+    }
+    dict_ = std::make_shared<Dictionary>(args_, in);
+
+    in.read((char*)&quant_, sizeof(bool));
+    input_ = createEmptyMatrix(quant_, map);
+    input_->load(in);
 
-  bool quant_input;
-  in.read((char*)&quant_input, sizeof(bool));
-  if (quant_input) {
-    quant_ = true;
-    input_ = std::make_shared<QuantMatrix>();
+    in.read((char*)&args_->qout, sizeof(bool));
+    output_ = createEmptyMatrix(quant_ && args_->qout, map);
+    output_->load(in);
   }
-  input_->load(in);
 
-  if (!quant_input && dict_->isPruned()) {
+  if (!quant_ && dict_->isPruned()) {
     throw std::invalid_argument(
         "Invalid model file.\n"
         "Please download the updated model from www.fasttext.cc.\n"
         "See issue #332 on Github for more information.\n");
   }
 
-  in.read((char*)&args_->qout, sizeof(bool));
-  if (quant_ && args_->qout) {
-    output_ = std::make_shared<QuantMatrix>();
-  }
-  output_->load(in);
-
   auto loss = createLoss(output_);
   bool normalizeGradient = (args_->model == model_name::sup);
   model_ = std::make_shared<Model>(input_, output_, loss, normalizeGradient);
 }
 
+void FastText::loadAlignedModel(
+    std::istream& in,
+    std::shared_ptr<const MemoryMap> map) {
+  int32_t nsections, alignment;
+  in.read((char*)&nsections, sizeof(int32_t));
+  in.read((char*)&alignment, sizeof(int32_t));
+  if (!in || nsections <= 0 || alignment != FASTTEXT_SECTION_ALIGNMENT) {
+    throw std::invalid_argument("Invalid model file.");
+  }
+  std::vector<ModelSection> sections(nsections);
+  in.read((char*)sections.data(), nsections * sizeof(ModelSection));
+
+  auto seekSection = [&](model_section id) -> const ModelSection& {
+    for (const auto& section : sections) {
+      if (section.id == id) {
+        in.seekg(section.offset);
+        if (!in) {
+          break;
+        }
+        return section;
+      }
+    }
+    throw std::invalid_argument("Invalid model file.");
+  };
+
+  seekSection(model_section::args);
+  args_->load(in);
+
+  seekSection(model_section::dictionary);
+  dict_ = std::make_shared<Dictionary>(args_, in, true);
+
+  quant_ = seekSection(model_section::input).quant;
+  input_ = createEmptyMatrix(quant_, map);
+  input_->load(in);
+
+  args_->qout = seekSection(model_section::output).quant;
+  output_ = createEmptyMatrix(args_->qout, map);
+  output_->load(in);
+}
+
+std::shared_ptr<Matrix> FastText::createEmptyMatrix(
+    bool quant,
+    std::shared_ptr<const MemoryMap> map) const {
+  if (quant) {
+    return std::make_shared<QuantMatrix>(map);
+  }
+  if (map) {
+    return std::make_shared<MappedMatrix>(map);
+  }
+  return std::make_shared<DenseMatrix>();
+}
+
 void FastText::printInfo(real progress, real loss, std::ostream& log_stream) {
   std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
   double t =
@@ -317,6 +510,10 @@ void FastText::quantize(const Args& qargs) {
       std::dynamic_pointer_cast<DenseMatrix>(input_);
   std::shared_ptr<DenseMatrix> output =
       std::dynamic_pointer_cast<DenseMatrix>(output_);
+  if (!input || !output) {
+    throw std::invalid_argument(
+        "Memory-mapped models cannot be quantized, load them normally.");
+  }
   bool normalizeGradient = (args_->model == model_name::sup);
 
   if (qargs.cutoff > 0 && qargs.cutoff < input->size(0)) {
@@ -382,7 +579,7 @@ void FastText::cbow(
     bow.clear();
     for (int32_t c = -boundary; c <= boundary; c++) {
       if (c != 0 && w + c >= 0 && w + c < line.size()) {
-        const std::vector<int32_t>& ngrams = dict_->getSubwords(line[w + c]);
+        SubwordRange ngrams = dict_->getSubwords(line[w + c]);
         bow.insert(bow.end(), ngrams.cbegin(), ngrams.cend());
       }
     }
@@ -397,10 +594,11 @@ void FastText::skipgram(
   std::uniform_int_distribution<> uniform(1, args_->ws);
   for (int32_t w = 0; w < line.size(); w++) {
     int32_t boundary = uniform(state.rng);
-    const std::vector<int32_t>& ngrams = dict_->getSubwords(line[w]);
+    SubwordRange ngrams = dict_->getSubwords(line[w]);
     for (int32_t c = -boundary; c <= boundary; c++) {
       if (c != 0 && w + c >= 0 && w + c < line.size()) {
-        model_->update(ngrams, line, w + c, lr, state);
+        model_->update(
+            ngrams.begin(), ngrams.size(), line, w + c, lr, state);
       }
     }
   }
@@ -417,38 +615,149 @@ FastText::test(std::istream& in, int32_t k, real threshold) {
 
 void FastText::test(std::istream& in, int32_t k, real threshold, Meter& meter)
     const {
-  std::vector<int32_t> line;
-  std::vector<int32_t> labels;
-  Predictions predictions;
+  test(in, k, threshold, meter, 1);
+}
 
-  while (in.peek() != EOF) {
-    line.clear();
-    labels.clear();
-    dict_->getLine(in, line, labels);
+void FastText::test(
+    std::istream& in,
+    int32_t k,
+    real threshold,
+    Meter& meter,
+    int32_t nthreads) const {
+  predictLines(
+      in,
+      k,
+      threshold,
+      nthreads,
+      [&meter](
+          const std::vector<int32_t>& labels, const Predictions& predictions) {
+        if (!labels.empty()) {
+          meter.log(labels, predictions);
+        }
+      });
+}
 
-    if (!labels.empty() && !line.empty()) {
-      predictions.clear();
-      predict(k, line, predictions, threshold);
-      meter.log(labels, predictions);
-    }
+void FastText::predict(
+    int32_t k,
+    const std::vector<int32_t>& words,
+    Predictions& predictions,
+    real threshold) const {
+  if (words.empty()) {
+    return;
   }
+  Model::State state(args_->dim, dict_->nlabels(), 0);
+  predict(k, words, predictions, state, threshold);
 }
 
 void FastText::predict(
     int32_t k,
     const std::vector<int32_t>& words,
     Predictions& predictions,
+    Model::State& state,
     real threshold) const {
   if (words.empty()) {
     return;
   }
-  Model::State state(args_->dim, dict_->nlabels(), 0);
   if (args_->model != model_name::sup) {
     throw std::invalid_argument("Model needs to be supervised for prediction!");
   }
   model_->predict(words, k, threshold, predictions, state);
 }
 
+void FastText::predict(
+    int32_t k,
+    const std::vector<std::vector<int32_t>>& documents,
+    std::vector<Predictions>& predictions,
+    Model::State& state,
+    real threshold) const {
+  if (args_->model != model_name::sup) {
+    throw std::invalid_argument("Model needs to be supervised for prediction!");
+  }
+  model_->predict(documents, k, threshold, predictions, state);
+}
+
+void FastText::predictLines(
+    std::istream& in,
+    int32_t k,
+    real threshold,
+    int32_t nthreads,
+    const LineCallback& callback) const {
+  if (args_->model != model_name::sup) {
+    throw std::invalid_argument("Model needs to be supervised for prediction!");
+  }
+  nthreads = std::max(nthreads, 1);
+  const int32_t chunkLines = PREDICT_CHUNK_LINES * nthreads;
+
+  std::vector<Model::State> states;
+  states.reserve(nthreads);
+  for (int32_t t = 0; t < nthreads; t++) {
+    states.emplace_back(args_->dim, dict_->nlabels(), 0);
+  }
+  std::vector<std::vector<std::vector<int32_t>>> batches(nthreads);
+  std::vector<std::vector<Predictions>> batchPredictions(nthreads);
+  std::vector<TokenScratch> scratch(nthreads);
+  std::vector<std::string> texts(nthreads);
+  std::vector<std::vector<int32_t>> labels(chunkLines);
+  std::vector<Predictions> predictions(chunkLines);
+
+  auto predictSlice = [&](int32_t t, int32_t begin, int32_t end) {
+    std::istringstream iss(texts[t]);
+    Tokenizer tokens(iss);
+    std::vector<std::vector<int32_t>>& batch = batches[t];
+    for (int32_t i = begin; i < end; i += PREDICT_BATCH_SIZE) {
+      batch.resize(std::min(end - i, int32_t(PREDICT_BATCH_SIZE)));
+      for (size_t j = 0; j < batch.size(); j++) {
+        dict_->getLine(tokens, batch[j], labels[i + j], scratch[t]);
+        if (batch[j].empty()) {
+          labels[i + j].clear();
+        }
+      }
+      predict(k, batch, batchPredictions[t], states[t], threshold);
+      for (size_t j = 0; j < batch.size(); j++) {
+        predictions[i + j].swap(batchPredictions[t][j]);
+      }
+    }
+  };
+
+  std::string line;
+  while (in.peek() != EOF) {
+    // Every thread gets a contiguous slice of the chunk as one text, so the
+    // lines are tokenized exactly as a sequential getLine() would.
+    int32_t nlines = 0;
+    std::vector<int32_t> bounds(1, 0);
+    for (int32_t t = 0; t < nthreads; t++) {
+      texts[t].clear();
+      for (int32_t i = 0; i < PREDICT_CHUNK_LINES && in.peek() != EOF; i++) {
+        std::getline(in, line);
+        texts[t] += line;
+        if (!in.eof()) {
+          texts[t] += '\n';
+        }
+        nlines++;
+      }
+      bounds.push_back(nlines);
+    }
+
+    if (nthreads == 1) {
+      predictSlice(0, 0, nlines);
+    } else {
+      std::vector<std::thread> threads;
+      for (int32_t t = 0; t < nthreads; t++) {
+        if (bounds[t] < bounds[t + 1]) {
+          threads.push_back(std::thread(
+              [&, t]() { predictSlice(t, bounds[t], bounds[t + 1]); }));
+        }
+      }
+      for (auto& thread : threads) {
+        thread.join();
+      }
+    }
+    for (int32_t i = 0; i < nlines; i++) {
+      callback(labels[i], predictions[i]);
+    }
+  }
+}
+
 void FastText::predict(const std::vector<int32_t>& words, Predictions& predictions) const {
   if (words.empty()) {
     return;
@@ -468,18 +777,31 @@ bool FastText::predictLine(
     std::vector<std::pair<real, std::string>>& predictions,
     int32_t k,
     real threshold) const {
-  predictions.clear();
+  InferenceContext context(*this);
+  return predictLine(in, predictions, k, threshold, context);
+}
+
+bool FastText::predictLine(
+    std::istream& in,
+    std::vector<std::pair<real, std::string>>& predictions,
+    int32_t k,
+    real threshold,
+    InferenceContext& context) const {
   if (in.peek() == EOF) {
+    predictions.clear();
     return false;
   }
 
-  std::vector<int32_t> words, labels;
-  dict_->getLine(in, words, labels);
-  Predictions linePredictions;
-  predict(k, words, linePredictions, threshold);
-  predictions.reserve(linePredictions.size());
-  for (const auto& p : linePredictions) {
-    predictions.emplace_back(std::exp(p.first), dict_->getLabel(p.second));
+  dict_->getLine(in, context.words, context.labels, context.scratch);
+  Predictions& linePredictions = context.predictions;
+  linePredictions.clear();
+  predict(k, context.words, linePredictions, context.state, threshold);
+  // resize() keeps the strings that are already there, so their buffers are
+  // reused by the assignments below.
+  predictions.resize(linePredictions.size());
+  for (size_t i = 0; i < linePredictions.size(); i++) {
+    predictions[i].first = std::exp(linePredictions[i].first);
+    dict_->getLabel(linePredictions[i].second, predictions[i].second);
   }
 
   return true;
@@ -505,11 +827,19 @@ bool FastText::predictLine(std::istream& in, std::vector<std::pair<real, std::st
 
 
 void FastText::getSentenceVector(std::istream& in, fasttext::Vector& svec) {
+  InferenceContext context(*this);
+  getSentenceVector(in, svec, context);
+}
+
+void FastText::getSentenceVector(
+    std::istream& in,
+    fasttext::Vector& svec,
+    InferenceContext& context) const {
   // std::istream is slow
   svec.zero();
   if (args_->model == model_name::sup) {
-    std::vector<int32_t> line, labels;
-    dict_->getLine(in, line, labels);
+    const std::vector<int32_t>& line = context.words;
+    dict_->getLine(in, context.words, context.labels, context.scratch);
     for (int32_t i = 0; i < line.size(); i++) {
       addInputVector(svec, line[i]);
     }
@@ -517,14 +847,35 @@ void FastText::getSentenceVector(std::istream& in, fasttext::Vector& svec) {
       svec.mul(1.0 / line.size());
     }
   } else {
-    Vector vec(args_->dim);
-    std::string sentence;
-    std::getline(in, sentence);
-    std::istringstream iss(sentence);
-    std::string word;
+    Vector& vec = context.vec;
+    const std::string& sentence = context.sentence;
+    std::string& word = context.word;
+    std::getline(in, context.sentence);
     int32_t count = 0;
-    while (iss >> word) {
-      getWordVector(vec, word);
+    // Splits on the same characters as operator>> in the "C" locale.
+    size_t i = 0;
+    while (i < sentence.size()) {
+      while (i < sentence.size() && std::isspace((unsigned char)sentence[i])) {
+        i++;
+      }
+      size_t j = i;
+      while (j < sentence.size() && !std::isspace((unsigned char)sentence[j])) {
+        j++;
+      }
+      if (j == i) {
+        break;
+      }
+      word.assign(sentence, i, j - i);
+      i = j;
+
+      dict_->getSubwords(word, context.ngrams, context.scratch);
+      vec.zero();
+      for (int32_t ngram : context.ngrams) {
+        addInputVector(vec, ngram);
+      }
+      if (context.ngrams.size() > 0) {
+        vec.mul(1.0 / context.ngrams.size());
+      }
       real norm = vec.norm();
       if (norm > 0) {
         vec.mul(1.0 / norm);
@@ -567,23 +918,122 @@ void FastText::ngramVectors(std::string word) {
 }
 
 void FastText::precomputeWordVectors(DenseMatrix& wordVectors) {
-  Vector vec(args_->dim);
+  computeWordVectors(wordVectors);
+}
+
+// Same as getWordVector(vec, dict_->getWord(id)), without looking the
+// word up again.
+void FastText::getWordVectorById(Vector& vec, int32_t id) const {
+  const SubwordRange ngrams = dict_->getSubwords(id);
+  vec.zero();
+  for (int32_t ngram : ngrams) {
+    addInputVector(vec, ngram);
+  }
+  if (ngrams.size() > 0) {
+    vec.mul(1.0 / ngrams.size());
+  }
+}
+
+void FastText::computeWordVectors(DenseMatrix& wordVectors) const {
+  const int32_t nwords = dict_->nwords();
   wordVectors.zero();
-  for (int32_t i = 0; i < dict_->nwords(); i++) {
-    std::string word = dict_->getWord(i);
-    getWordVector(vec, word);
+  auto computeRows = [&](int32_t begin, int32_t end) {
+    Vector vec(args_->dim);
+    for (int32_t i = begin; i < end; i++) {
+      getWordVectorById(vec, i);
+      real norm = vec.norm();
+      if (norm > 0) {
+        wordVectors.addVectorToRow(vec, i, 1.0 / norm);
+      }
+    }
+  };
+  const int32_t nthreads = std::max(
+      std::min(nnThreads_, nwords / WORD_VECTORS_MIN_ROWS_PER_THREAD), 1);
+  if (nthreads == 1) {
+    computeRows(0, nwords);
+    return;
+  }
+  std::vector<std::thread> threads;
+  for (int32_t t = 0; t < nthreads; t++) {
+    const int32_t begin = int64_t(nwords) * t / nthreads;
+    const int32_t end = int64_t(nwords) * (t + 1) / nthreads;
+    threads.push_back(
+        std::thread([&, begin, end]() { computeRows(begin, end); }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+// The cache holds no key: a few rows spread over the vocabulary are
+// computed again and must match it bit for bit.
+bool FastText::loadWordVectorsCache(DenseMatrix& wordVectors) const {
+  std::ifstream ifs(wordVectorsCachePath_, std::ifstream::binary);
+  if (!ifs.is_open()) {
+    return false;
+  }
+  int32_t version;
+  int64_t m, n;
+  ifs.read((char*)&version, sizeof(int32_t));
+  ifs.read((char*)&m, sizeof(int64_t));
+  ifs.read((char*)&n, sizeof(int64_t));
+  if (!ifs || version != WORD_VECTORS_CACHE_VERSION ||
+      m != wordVectors.rows() || n != wordVectors.cols()) {
+    return false;
+  }
+  ifs.read((char*)wordVectors.data(), m * n * sizeof(real));
+  if (!ifs) {
+    return false;
+  }
+  DenseMatrix expected(1, n);
+  Vector vec(n);
+  const int64_t step = std::max(m / WORD_VECTORS_CHECK_ROWS, int64_t(1));
+  for (int64_t i = 0; i < m; i += step) {
+    getWordVectorById(vec, i);
+    expected.zero();
     real norm = vec.norm();
     if (norm > 0) {
-      wordVectors.addVectorToRow(vec, i, 1.0 / norm);
+      expected.addVectorToRow(vec, 0, 1.0 / norm);
+    }
+    if (std::memcmp(
+            expected.data(), wordVectors.data() + i * n, n * sizeof(real))) {
+      return false;
     }
   }
+  return true;
+}
+
+// The cache is only an optimization: when it cannot be written, the
+// vectors are still used and computed again on the next load.
+void FastText::saveWordVectorsCache(const DenseMatrix& wordVectors) const {
+  std::ofstream ofs(wordVectorsCachePath_, std::ofstream::binary);
+  if (ofs.is_open()) {
+    const int32_t version = WORD_VECTORS_CACHE_VERSION;
+    ofs.write((char*)&version, sizeof(int32_t));
+    wordVectors.save(ofs);
+  }
+  if (!ofs) {
+    std::cerr << "Warning: cannot write the word vectors cache "
+              << wordVectorsCachePath_ << std::endl;
+  }
+}
+
+void FastText::setWordVectorsCache(const std::string& path) {
+  wordVectorsCachePath_ = path;
 }
 
 void FastText::lazyComputeWordVectors() {
   if (!wordVectors_) {
     wordVectors_ = std::unique_ptr<DenseMatrix>(
         new DenseMatrix(dict_->nwords(), args_->dim));
-    precomputeWordVectors(*wordVectors_);
+    if (!wordVectorsCachePath_.empty() &&
+        loadWordVectorsCache(*wordVectors_)) {
+      return;
+    }
+    computeWordVectors(*wordVectors_);
+    if (!wordVectorsCachePath_.empty()) {
+      saveWordVectorsCache(*wordVectors_);
+    }
   }
 }
 
@@ -596,55 +1046,294 @@ std::vector<std::pair<real, std::string>> FastText::getNN(
 
   lazyComputeWordVectors();
   assert(wordVectors_);
+  if (nnEf_ > 0) {
+    return getApproximateNN(query, k, {word});
+  }
   return getNN(*wordVectors_, query, k, {word});
 }
 
-std::vector<std::pair<real, std::string>> FastText::getNN(
-    const DenseMatrix& wordVectors,
+std::vector<std::vector<std::pair<real, std::string>>> FastText::getNNBatch(
+    const std::vector<std::string>& words,
+    int32_t k) {
+  std::vector<Vector> queries;
+  queries.reserve(words.size());
+  for (const auto& word : words) {
+    queries.emplace_back(args_->dim);
+    getWordVector(queries.back(), word);
+  }
+
+  lazyComputeWordVectors();
+  assert(wordVectors_);
+  std::vector<std::vector<std::pair<real, std::string>>> results(
+      words.size());
+  if (nnEf_ > 0) {
+    for (size_t i = 0; i < words.size(); i++) {
+      results[i] = getApproximateNN(queries[i], k, {words[i]});
+    }
+    return results;
+  }
+  std::vector<int32_t> banned;
+  banned.reserve(words.size());
+  for (const auto& word : words) {
+    const std::vector<int32_t> ids = getBannedIds({word});
+    banned.push_back(ids.empty() ? -1 : ids[0]);
+  }
+  std::vector<Predictions> nearest;
+  findExactNNBatch(*wordVectors_, queries, k, banned, nearest);
+  for (size_t i = 0; i < words.size(); i++) {
+    results[i].reserve(nearest[i].size());
+    for (const auto& neighbor : nearest[i]) {
+      results[i].emplace_back(
+          neighbor.first, dict_->getWord(neighbor.second));
+    }
+  }
+  return results;
+}
+
+void FastText::setNNIndex(int32_t ef, const std::string& path) {
+  if (path != nnIndexPath_) {
+    nnIndex_.reset();
+  }
+  nnEf_ = ef;
+  nnIndexPath_ = path;
+}
+
+void FastText::setNNThreads(int32_t nthreads) {
+  nnThreads_ = std::max(nthreads, 1);
+}
+
+void FastText::lazyComputeNNIndex() {
+  if (nnIndex_) {
+    return;
+  }
+  nnIndex_ = std::unique_ptr<HnswIndex>(new HnswIndex());
+  if (!nnIndexPath_.empty()) {
+    std::ifstream ifs(nnIndexPath_, std::ifstream::binary);
+    if (ifs.is_open()) {
+      try {
+        nnIndex_->load(ifs, *wordVectors_);
+        return;
+      } catch (const std::invalid_argument&) {
+        // built for another model, rebuilt and overwritten below
+      }
+    }
+  }
+  nnIndex_->build(*wordVectors_);
+  if (!nnIndexPath_.empty()) {
+    std::ofstream ofs(nnIndexPath_, std::ofstream::binary);
+    if (!ofs.is_open()) {
+      throw std::invalid_argument(
+          nnIndexPath_ + " cannot be opened for saving!");
+    }
+    nnIndex_->save(ofs);
+  }
+}
+
+std::vector<std::pair<real, std::string>> FastText::getApproximateNN(
     const Vector& query,
     int32_t k,
     const std::set<std::string>& banSet) {
-  std::vector<std::pair<real, std::string>> heap;
-  heap.reserve(size_t(k + 1));
-
+  lazyComputeNNIndex();
   real queryNorm = query.norm();
   if (std::abs(queryNorm) < 1e-8) {
     queryNorm = 1;
   }
-
-  int32_t i = 0;
-  while (i < dict_->nwords() && heap.size() < k) {
-    std::string word = dict_->getWord(i);
-    if (banSet.find(word) == banSet.end()) {
-      real dp = wordVectors.dotRow(query, i);
-      real similarity = dp / queryNorm;
-      heap.emplace_back(similarity, std::move(word));
+  const std::vector<int32_t> banned = getBannedIds(banSet);
+  // banned words can only take banned.size() of the slots
+  const int32_t n = k + banned.size();
+  std::vector<std::pair<real, std::string>> results;
+  results.reserve(k);
+  for (const auto& nearest : nnIndex_->search(query, n, std::max(nnEf_, n), nnVisited_)) {
+    if (int32_t(results.size()) < k &&
+        std::find(banned.begin(), banned.end(), nearest.second) ==
+            banned.end()) {
+      results.emplace_back(
+          nearest.first / queryNorm, dict_->getWord(nearest.second));
     }
-    ++i;
   }
+  return results;
+}
 
-  greater_first<typename decltype(heap)::value_type> cmp;
-  std::make_heap(std::begin(heap), std::end(heap), cmp);
+std::vector<int32_t> FastText::getBannedIds(
+    const std::set<std::string>& banSet) const {
+  std::vector<int32_t> banned;
+  for (const auto& word : banSet) {
+    int32_t id = dict_->getId(word);
+    if (id >= 0 && id < dict_->nwords()) {
+      banned.push_back(id);
+    }
+  }
+  return banned;
+}
 
-  while (i < dict_->nwords()) {
-    std::string word = dict_->getWord(i);
-    if (banSet.find(word) == banSet.end()) {
-      real dp = wordVectors.dotRow(query, i);
-      real similarity = dp / queryNorm;
-
-      if (similarity >= heap.front().first) {
-          heap.emplace_back(similarity, std::move(word));
-          std::push_heap(heap.begin(), heap.end(), cmp);
-          std::pop_heap(heap.begin(), heap.end(), cmp);
-          heap.pop_back();
+// Scores all the words in blocks that stay in cache while the dot products
+// are divided by the query norm, splitting the blocks between nnThreads_
+// threads. Only the ids of the k best words are selected, so no string is
+// built for the others.
+void FastText::findExactNN(
+    const DenseMatrix& wordVectors,
+    const Vector& query,
+    int32_t k,
+    const std::vector<int32_t>& banned,
+    Predictions& nearest) {
+  nearest.clear();
+  if (k <= 0) {
+    return;
+  }
+  const int64_t nwords = dict_->nwords();
+  const int64_t dim = wordVectors.cols();
+  real queryNorm = query.norm();
+  if (std::abs(queryNorm) < 1e-8) {
+    queryNorm = 1;
+  }
+  nnScores_.resize(nwords);
+  auto scoreRows = [&](int64_t begin, int64_t end) {
+    for (int64_t i = begin; i < end; i += NN_BLOCK_ROWS) {
+      const int64_t rows = std::min(int64_t(NN_BLOCK_ROWS), end - i);
+      real* scores = nnScores_.data() + i;
+      simd::gemv(
+          wordVectors.data() + i * dim, rows, dim, query.data(), scores);
+      for (int64_t j = 0; j < rows; j++) {
+        scores[j] = scores[j] / queryNorm;
       }
     }
-    ++i;
+  };
+  const int64_t nthreads = std::max(
+      std::min(int64_t(nnThreads_), nwords / NN_MIN_ROWS_PER_THREAD),
+      int64_t(1));
+  if (nthreads == 1) {
+    scoreRows(0, nwords);
+  } else {
+    std::vector<std::thread> threads;
+    const int64_t blocks = (nwords + NN_BLOCK_ROWS - 1) / NN_BLOCK_ROWS;
+    for (int64_t t = 0; t < nthreads; t++) {
+      const int64_t begin = blocks * t / nthreads * NN_BLOCK_ROWS;
+      const int64_t end =
+          std::min(blocks * (t + 1) / nthreads * NN_BLOCK_ROWS, nwords);
+      threads.push_back(std::thread([&, begin, end]() {
+        scoreRows(begin, end);
+      }));
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
   }
+  for (int32_t id : banned) {
+    nnScores_[id] = -std::numeric_limits<real>::infinity();
+  }
+  for (int32_t i : nnTopK_.select(
+           nnScores_.data(),
+           nwords,
+           k,
+           std::numeric_limits<real>::lowest())) {
+    nearest.emplace_back(nnScores_[i], i);
+  }
+}
 
-  std::sort(heap.begin(), heap.end(), cmp); // faster than std::sort_heap
+// For every block of NN_QUERY_BLOCK queries, the word vectors are scored in
+// tiles of NN_BLOCK_ROWS rows, and the best k of each tile are merged into
+// the results of the query. The values, and the order among equal values,
+// are the same as those of findExactNN.
+void FastText::findExactNNBatch(
+    const DenseMatrix& wordVectors,
+    const std::vector<Vector>& queries,
+    int32_t k,
+    const std::vector<int32_t>& banned,
+    std::vector<Predictions>& nearest) const {
+  const int64_t nwords = dict_->nwords();
+  const int64_t dim = wordVectors.cols();
+  const int64_t nqueries = queries.size();
+  nearest.assign(nqueries, Predictions());
+  if (k <= 0) {
+    return;
+  }
+  auto better = [](const std::pair<real, int32_t>& a,
+                   const std::pair<real, int32_t>& b) {
+    return a.first > b.first || (a.first == b.first && a.second > b.second);
+  };
+  auto searchBlock = [&](int64_t begin, int64_t end, TopK& topk) {
+    const int64_t nq = end - begin;
+    std::vector<real> x(nq * dim);
+    std::vector<real> norms(nq);
+    std::vector<real> tile(nq * NN_BLOCK_ROWS);
+    for (int64_t j = 0; j < nq; j++) {
+      const Vector& query = queries[begin + j];
+      std::copy(query.data(), query.data() + dim, x.data() + j * dim);
+      norms[j] = query.norm();
+      if (std::abs(norms[j]) < 1e-8) {
+        norms[j] = 1;
+      }
+    }
+    for (int64_t r = 0; r < nwords; r += NN_BLOCK_ROWS) {
+      const int64_t rows = std::min(int64_t(NN_BLOCK_ROWS), nwords - r);
+      simd::gemm(
+          wordVectors.data() + r * dim, rows, dim, x.data(), nq, tile.data());
+      for (int64_t j = 0; j < nq; j++) {
+        real* scores = tile.data() + j * rows;
+        for (int64_t i = 0; i < rows; i++) {
+          scores[i] = scores[i] / norms[j];
+        }
+        const int32_t ban = banned[begin + j];
+        if (ban >= r && ban < r + rows) {
+          scores[ban - r] = -std::numeric_limits<real>::infinity();
+        }
+        Predictions& best = nearest[begin + j];
+        // Later tiles hold higher ids, which win ties, so scores equal to
+        // the current k-th best are kept too.
+        const real threshold = int32_t(best.size()) < k
+            ? std::numeric_limits<real>::lowest()
+            : best.back().first;
+        const int64_t previous = best.size();
+        for (int32_t i : topk.select(scores, rows, k, threshold)) {
+          best.emplace_back(scores[i], r + i);
+        }
+        if (int64_t(best.size()) > previous) {
+          std::sort(best.begin(), best.end(), better);
+          if (int32_t(best.size()) > k) {
+            best.resize(k);
+          }
+        }
+      }
+    }
+  };
+  const int64_t blocks = (nqueries + NN_QUERY_BLOCK - 1) / NN_QUERY_BLOCK;
+  const int64_t nthreads =
+      std::max(std::min(int64_t(nnThreads_), blocks), int64_t(1));
+  auto searchBlocks = [&](int64_t t) {
+    TopK topk;
+    for (int64_t b = t; b < blocks; b += nthreads) {
+      searchBlock(
+          b * NN_QUERY_BLOCK,
+          std::min((b + 1) * NN_QUERY_BLOCK, nqueries),
+          topk);
+    }
+  };
+  if (nthreads == 1) {
+    searchBlocks(0);
+  } else {
+    std::vector<std::thread> threads;
+    for (int64_t t = 0; t < nthreads; t++) {
+      threads.push_back(std::thread([&, t]() { searchBlocks(t); }));
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+}
 
-  return heap;
+std::vector<std::pair<real, std::string>> FastText::getNN(
+    const DenseMatrix& wordVectors,
+    const Vector& query,
+    int32_t k,
+    const std::set<std::string>& banSet) {
+  Predictions nearest;
+  findExactNN(wordVectors, query, k, getBannedIds(banSet), nearest);
+  std::vector<std::pair<real, std::string>> results;
+  results.reserve(nearest.size());
+  for (const auto& neighbor : nearest) {
+    results.emplace_back(neighbor.first, dict_->getWord(neighbor.second));
+  }
+  return results;
 }
 
 // depracted. use getNN instead
@@ -676,6 +1365,9 @@ std::vector<std::pair<real, std::string>> FastText::getAnalogies(
 
   lazyComputeWordVectors();
   assert(wordVectors_);
+  if (nnEf_ > 0) {
+    return getApproximateNN(query, k, {wordA, wordB, wordC});
+  }
   return getNN(*wordVectors_, query, k, {wordA, wordB, wordC});
 }
 
@@ -700,23 +1392,25 @@ void FastText::analogies(int32_t k) {
 void FastText::trainThread(int32_t threadId) {
   std::ifstream ifs(args_->input);
   utils::seek(ifs, threadId * utils::size(ifs) / args_->thread);
+  Tokenizer tokens(ifs);
 
   Model::State state(args_->dim, output_->size(0), threadId);
 
   const int64_t ntokens = dict_->ntokens();
   int64_t localTokenCount = 0;
   std::vector<int32_t> line, labels;
+  TokenScratch scratch;
   while (tokenCount_ < args_->epoch * ntokens) {
     real progress = real(tokenCount_) / (args_->epoch * ntokens);
     real lr = args_->lr * (1.0 - progress);
     if (args_->model == model_name::sup) {
-      localTokenCount += dict_->getLine(ifs, line, labels);
+      localTokenCount += dict_->getLine(tokens, line, labels, scratch);
       supervised(state, lr, line, labels);
     } else if (args_->model == model_name::cbow) {
-      localTokenCount += dict_->getLine(ifs, line, state.rng);
+      localTokenCount += dict_->getLine(tokens, line, state.rng);
       cbow(state, lr, line);
     } else if (args_->model == model_name::sg) {
-      localTokenCount += dict_->getLine(ifs, line, state.rng);
+      localTokenCount += dict_->getLine(tokens, line, state.rng);
       skipgram(state, lr, line);
     }
     if (localTokenCount > args_->lrUpdateRate) {
@@ -781,7 +1475,7 @@ void FastText::loadVectors(const std::string& filename) {
 std::shared_ptr<Matrix> FastText::createRandomMatrix() const {
   std::shared_ptr<DenseMatrix> input = std::make_shared<DenseMatrix>(
       dict_->nwords() + args_->bucket, args_->dim);
-  input->uniform(1.0 / args_->dim);
+  input->uniform(1.0 / args_->dim, args_->thread);
 
   return input;
 }
@@ -796,9 +1490,90 @@ std::shared_ptr<Matrix> FastText::createTrainOutputMatrix() const {
   return output;
 }
 
+// Identifies the input file by its path, size and modification time, and
+// lists the arguments that change which words are kept and their counts.
+// The ones only used once the words are known, such as -t, -minn, -maxn
+// and -bucket, are applied when the cached dictionary is loaded.
+std::string FastText::dictionaryCacheKey() const {
+  struct stat st;
+  if (stat(args_->input.c_str(), &st) != 0) {
+    throw std::invalid_argument(args_->input + " cannot be opened!");
+  }
+  // in nanoseconds where available, so that a file rewritten within the
+  // same second is not mistaken for the cached one
+  int64_t mtime = int64_t(st.st_mtime) * 1000000000;
+#if defined(__linux__)
+  mtime += st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+  mtime += st.st_mtimespec.tv_nsec;
+#endif
+  std::ostringstream key;
+  key << args_->input << " " << int64_t(st.st_size) << " " << mtime << " "
+      << args_->minCount << " " << args_->minCountLabel << " "
+      << args_->vocabCapacity << " " << args_->label;
+  return key.str();
+}
+
+bool FastText::loadDictionaryCache() {
+  std::ifstream ifs(args_->dictCache, std::ifstream::binary);
+  if (!ifs.is_open()) {
+    return false;
+  }
+  int32_t version;
+  std::string key;
+  ifs.read((char*)&version, sizeof(int32_t));
+  std::getline(ifs, key, '\0');
+  if (!ifs || version != DICTIONARY_CACHE_VERSION ||
+      key != dictionaryCacheKey()) {
+    return false;
+  }
+  std::shared_ptr<Dictionary> dict;
+  try {
+    dict = std::make_shared<Dictionary>(args_, ifs);
+  } catch (const std::invalid_argument&) {
+    // truncated or corrupted, rebuilt and overwritten by the caller
+    return false;
+  }
+  if (!ifs) {
+    return false;
+  }
+  dict_ = dict;
+  if (args_->verbose > 0) {
+    std::cerr << "Read " << dict_->ntokens() / 1000000 << "M words from "
+              << args_->dictCache << std::endl;
+    std::cerr << "Number of words:  " << dict_->nwords() << std::endl;
+    std::cerr << "Number of labels: " << dict_->nlabels() << std::endl;
+  }
+  return true;
+}
+
+// Writes to a temporary file first, so that a run that stops halfway or
+// another run reading the cache never sees a partial dictionary.
+void FastText::saveDictionaryCache() const {
+  const std::string tmp = args_->dictCache + ".tmp";
+  std::ofstream ofs(tmp, std::ofstream::binary);
+  if (!ofs.is_open()) {
+    throw std::invalid_argument(tmp + " cannot be opened for saving!");
+  }
+  const int32_t version = DICTIONARY_CACHE_VERSION;
+  const std::string key = dictionaryCacheKey();
+  ofs.write((char*)&version, sizeof(int32_t));
+  ofs.write(key.data(), key.size());
+  ofs.put(0);
+  dict_->save(ofs);
+  ofs.close();
+#ifdef _WIN32
+  // rename only replaces an existing file atomically on POSIX
+  std::remove(args_->dictCache.c_str());
+#endif
+  if (!ofs || std::rename(tmp.c_str(), args_->dictCache.c_str()) != 0) {
+    std::remove(tmp.c_str());
+    throw std::invalid_argument(args_->dictCache + " cannot be saved!");
+  }
+}
+
 void FastText::train(const Args& args) {
   args_ = std::make_shared<Args>(args);
-  dict_ = std::make_shared<Dictionary>(args_);
   if (args_->input == "-") {
     // manage expectations
     throw std::invalid_argument("Cannot use stdin for training!");
@@ -808,8 +1583,14 @@ void FastText::train(const Args& args) {
     throw std::invalid_argument(
         args_->input + " cannot be opened for training!");
   }
-  dict_->readFromFile(ifs);
   ifs.close();
+  if (args_->dictCache.empty() || !loadDictionaryCache()) {
+    dict_ = std::make_shared<Dictionary>(args_);
+    dict_->readFromFile(args_->input, args_->thread);
+    if (!args_->dictCache.empty()) {
+      saveDictionaryCache();
+    }
+  }
 
   if (!args_->pretrainedVectors.empty()) {
     input_ = getInputMatrixFromFile(args_->pretrainedVectors);
@@ -823,6 +1604,36 @@ void FastText::train(const Args& args) {
   startThreads();
 }
 
+// Keeps thread i on the i-th cpu (modulo their number) that the process
+// may run on, so that it stays next to the cache lines it has touched.
+// Only supported on Linux, elsewhere the threads are left unpinned.
+void FastText::pinThread(std::thread& thread, int32_t i) {
+#if defined(__linux__)
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0 ||
+      CPU_COUNT(&allowed) == 0) {
+    std::cerr << "Warning: cannot read the cpus of the process, thread " << i
+              << " is not pinned" << std::endl;
+    return;
+  }
+  int32_t rank = i % CPU_COUNT(&allowed);
+  int32_t cpu = 0;
+  while (!CPU_ISSET(cpu, &allowed) || rank-- > 0) {
+    cpu++;
+  }
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  const int error =
+      pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpus);
+  if (error != 0) {
+    std::cerr << "Warning: cannot pin thread " << i << " to cpu " << cpu
+              << ": " << std::strerror(error) << std::endl;
+  }
+#endif
+}
+
 void FastText::startThreads() {
   start_ = std::chrono::steady_clock::now();
   tokenCount_ = 0;
@@ -831,6 +1642,9 @@ void FastText::startThreads() {
   threads.reserve(args_->thread);
   for (int32_t i = 0; i < args_->thread; i++) {
     threads.push_back(std::thread([=]() { trainThread(i); }));
+    if (args_->pinThreads) {
+      pinThread(threads.back(), i);
+    }
   }
   const int64_t ntokens = dict_->ntokens();
   // Same condition as trainThread
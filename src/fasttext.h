@@ -12,26 +12,47 @@
 
 #include <atomic>
 #include <chrono>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <queue>
 #include <set>
+#include <thread>
 #include <tuple>
 
 #include "args.h"
 #include "densematrix.h"
 #include "dictionary.h"
+#include "hnsw.h"
 #include "matrix.h"
+#include "memorymap.h"
 #include "meter.h"
 #include "model.h"
 #include "real.h"
+#include "topk.h"
 #include "utils.h"
 #include "vector.h"
 
 namespace fasttext {
 
+class InferenceContext;
+
 class FastText {
+ public:
+  using LineCallback = std::function<
+      void(const std::vector<int32_t>& labels, const Predictions& predictions)>;
+
  protected:
+  static const int32_t PREDICT_CHUNK_LINES = 1024;
+  static const int32_t PREDICT_BATCH_SIZE = 64;
+  static const int64_t NN_BLOCK_ROWS = 4096;
+  static const int64_t NN_MIN_ROWS_PER_THREAD = 32768;
+  static const int64_t NN_QUERY_BLOCK = 64;
+  static const int32_t WORD_VECTORS_CACHE_VERSION = 1;
+  static const int32_t WORD_VECTORS_CHECK_ROWS = 64;
+  static const int32_t WORD_VECTORS_MIN_ROWS_PER_THREAD = 1024;
+  static const int32_t DICTIONARY_CACHE_VERSION = 1;
+
   std::shared_ptr<Args> args_;
   std::shared_ptr<Dictionary> dict_;
 
@@ -44,17 +65,49 @@ class FastText {
   std::atomic<real> loss_{};
 
   std::chrono::steady_clock::time_point start_;
-  void signModel(std::ostream&);
+  void signModel(std::ostream&, int32_t version);
   bool checkModel(std::istream&);
+  void saveAlignedModel(std::ostream&);
+  void loadAlignedModel(std::istream&, std::shared_ptr<const MemoryMap> map);
+  std::shared_ptr<Matrix> createEmptyMatrix(
+      bool quant,
+      std::shared_ptr<const MemoryMap> map) const;
+  static void pinThread(std::thread& thread, int32_t i);
   void startThreads();
   void addInputVector(Vector&, int32_t) const;
   void trainThread(int32_t);
+  std::string dictionaryCacheKey() const;
+  bool loadDictionaryCache();
+  void saveDictionaryCache() const;
+  void loadModel(std::istream& in, std::shared_ptr<const MemoryMap> map);
   std::vector<std::pair<real, std::string>> getNN(
       const DenseMatrix& wordVectors,
       const Vector& queryVec,
       int32_t k,
       const std::set<std::string>& banSet);
+  std::vector<int32_t> getBannedIds(const std::set<std::string>& banSet) const;
+  void findExactNN(
+      const DenseMatrix& wordVectors,
+      const Vector& queryVec,
+      int32_t k,
+      const std::vector<int32_t>& banned,
+      Predictions& nearest);
+  void findExactNNBatch(
+      const DenseMatrix& wordVectors,
+      const std::vector<Vector>& queries,
+      int32_t k,
+      const std::vector<int32_t>& banned,
+      std::vector<Predictions>& nearest) const;
+  void getWordVectorById(Vector& vec, int32_t id) const;
+  void computeWordVectors(DenseMatrix& wordVectors) const;
+  bool loadWordVectorsCache(DenseMatrix& wordVectors) const;
+  void saveWordVectorsCache(const DenseMatrix& wordVectors) const;
   void lazyComputeWordVectors();
+  void lazyComputeNNIndex();
+  std::vector<std::pair<real, std::string>> getApproximateNN(
+      const Vector& queryVec,
+      int32_t k,
+      const std::set<std::string>& banSet);
   void printInfo(real, real, std::ostream&);
   std::shared_ptr<Matrix> getInputMatrixFromFile(const std::string&) const;
   std::shared_ptr<Matrix> createRandomMatrix() const;
@@ -72,6 +125,15 @@ class FastText {
   bool quant_;
   int32_t version;
   std::unique_ptr<DenseMatrix> wordVectors_;
+  std::string wordVectorsCachePath_;
+  std::unique_ptr<HnswIndex> nnIndex_;
+  int32_t nnEf_;
+  std::string nnIndexPath_;
+  int32_t nnThreads_;
+  // Buffers of the exact and approximate searches, kept between queries.
+  std::vector<real> nnScores_;
+  TopK nnTopK_;
+  VisitedSet nnVisited_;
 
  public:
   FastText();
@@ -101,14 +163,28 @@ class FastText {
 
   void saveModel(const std::string& filename);
 
+  // Writes the aligned format: sections are padded so that the matrices can
+  // be memory-mapped in place, and the dictionary lookup tables are stored
+  // instead of being rebuilt at load time.
+  void saveModel(const std::string& filename, bool aligned);
+
   void saveOutput(const std::string& filename);
 
   void loadModel(std::istream& in);
 
   void loadModel(const std::string& filename);
 
+  // Maps the file instead of reading it: the matrices point straight into
+  // the shared page cache and are read-only.
+  void loadModel(const std::string& filename, bool mmap);
+
   void getSentenceVector(std::istream& in, Vector& vec);
 
+  void getSentenceVector(
+      std::istream& in,
+      Vector& vec,
+      InferenceContext& context) const;
+
   void quantize(const Args& qargs);
 
   std::tuple<int64_t, double, double>
@@ -116,14 +192,49 @@ class FastText {
 
   void test(std::istream& in, int32_t k, real threshold, Meter& meter) const;
 
+  void test(
+      std::istream& in,
+      int32_t k,
+      real threshold,
+      Meter& meter,
+      int32_t nthreads) const;
+
   void predict(
       int32_t k,
       const std::vector<int32_t>& words,
       Predictions& predictions,
       real threshold = 0.0) const;
 
+  void predict(
+      int32_t k,
+      const std::vector<int32_t>& words,
+      Predictions& predictions,
+      Model::State& state,
+      real threshold = 0.0) const;
+
   void predict(const std::vector<int32_t>& words, Predictions& predictions) const;
 
+  // Predicts many documents at once, see Model::predict. Reading the output
+  // matrix once per batch makes bulk scoring compute bound rather than
+  // memory bound for models with many labels.
+  void predict(
+      int32_t k,
+      const std::vector<std::vector<int32_t>>& documents,
+      std::vector<Predictions>& predictions,
+      Model::State& state,
+      real threshold = 0.0) const;
+
+  // Predicts every line of `in` on nthreads threads. Lines are read in
+  // chunks, each thread predicts its lines in batches with its own
+  // Model::State, and callback is called once per line in input order.
+  // Lines without words get no labels.
+  void predictLines(
+      std::istream& in,
+      int32_t k,
+      real threshold,
+      int32_t nthreads,
+      const LineCallback& callback) const;
+
   bool predictLine(
       std::istream& in,
       std::vector<std::pair<real, std::string>>& predictions,
@@ -132,6 +243,16 @@ class FastText {
 
   bool predictLine(std::istream& in, std::vector<std::pair<real, std::string>>& predictions) const;
 
+  // Same as predictLine above, but all scratch space comes from context and
+  // the label strings of predictions are reused, so a warmed up context
+  // predicts without allocating.
+  bool predictLine(
+      std::istream& in,
+      std::vector<std::pair<real, std::string>>& predictions,
+      int32_t k,
+      real threshold,
+      InferenceContext& context) const;
+
   std::vector<std::pair<std::string, Vector>> getNgramVectors(
       const std::string& word) const;
 
@@ -139,12 +260,37 @@ class FastText {
       const std::string& word,
       int32_t k);
 
+  // Same as getNN for every word of words. Blocks of the queries are
+  // scored together against tiles of word vectors that stay in cache, so
+  // the word vectors are read once per block of queries instead of once per
+  // query, and the blocks are split between the threads of setNNThreads.
+  std::vector<std::vector<std::pair<real, std::string>>> getNNBatch(
+      const std::vector<std::string>& words,
+      int32_t k);
+
   std::vector<std::pair<real, std::string>> getAnalogies(
       int32_t k,
       const std::string& wordA,
       const std::string& wordB,
       const std::string& wordC);
 
+  // Makes getNN and getAnalogies search an approximate index instead of
+  // scanning every word, keeping ef candidates per query (0 goes back to
+  // the exact scan). The index is built at the first query; if path is
+  // given it is loaded from there when present, and saved there otherwise.
+  void setNNIndex(int32_t ef, const std::string& path = std::string());
+
+  // Number of threads computing the word vectors behind getNN, getNNBatch
+  // and getAnalogies, and scoring them in the exact search. Small
+  // vocabularies are handled on one thread regardless.
+  void setNNThreads(int32_t nthreads);
+
+  // Makes the normalized word vectors behind getNN, getNNBatch and
+  // getAnalogies be read from path when they are next needed, instead of
+  // being computed. If path does not exist or holds the vectors of another
+  // model, they are computed and saved there.
+  void setWordVectorsCache(const std::string& path);
+
   void train(const Args& args);
 
   int getDimension() const;
@@ -193,6 +339,24 @@ class FastText {
       std::vector<std::pair<real, std::string>>& results);
 };
 
+// Per-thread buffers for inference. A loaded FastText is not modified by
+// the const inference methods, so one instance can serve any number of
+// threads as long as each of them passes its own context.
+class InferenceContext {
+ public:
+  explicit InferenceContext(const FastText& fasttext);
+
+  Model::State state;
+  Predictions predictions;
+  std::vector<int32_t> words;
+  std::vector<int32_t> labels;
+  std::vector<int32_t> ngrams;
+  TokenScratch scratch;
+  Vector vec;
+  std::string sentence;
+  std::string word;
+};
+
 template<typename T>
 struct greater_first {
     bool operator()(const T& x, const T& y) {
@@ -0,0 +1,355 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "hnsw.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+
+#include "simd.h"
+
+namespace fasttext {
+
+namespace {
+
+const int32_t FINGERPRINT_ROWS = 1024;
+// Levels drawn by build stay below 54 for any m >= 2.
+const int32_t MAX_LEVEL = 64;
+
+} // namespace
+
+HnswIndex::HnswIndex(int32_t m, int32_t efConstruction)
+    : m_(m),
+      efConstruction_(efConstruction),
+      entryPoint_(-1),
+      maxLevel_(-1),
+      fingerprint_(0),
+      vectors_(nullptr) {}
+
+real HnswIndex::similarity(const real* query, int32_t row) const {
+  const int64_t dim = vectors_->cols();
+  return simd::dot(vectors_->data() + row * dim, query, dim);
+}
+
+int32_t HnswIndex::maxLinks(int32_t level) const {
+  return level == 0 ? 2 * m_ : m_;
+}
+
+int32_t* HnswIndex::links(int32_t row, int32_t level) {
+  if (level == 0) {
+    return links0_.data() + int64_t(row) * 2 * m_;
+  }
+  return upperLinks_[row].data() + (level - 1) * m_;
+}
+
+const int32_t* HnswIndex::links(int32_t row, int32_t level) const {
+  if (level == 0) {
+    return links0_.data() + int64_t(row) * 2 * m_;
+  }
+  return upperLinks_[row].data() + (level - 1) * m_;
+}
+
+// Best-first search of one layer from the rows in nearest, which on
+// return holds the ef rows closest to the query, best first.
+template <typename Visited>
+void HnswIndex::searchLayer(
+    const real* query,
+    std::vector<std::pair<real, int32_t>>& nearest,
+    int32_t ef,
+    int32_t level,
+    Visited& visited) const {
+  using Entry = std::pair<real, int32_t>;
+  std::priority_queue<Entry> candidates;
+  std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> best;
+  visited.clear();
+  for (const auto& entry : nearest) {
+    visited.insert(entry.second);
+    candidates.push(entry);
+    best.push(entry);
+  }
+  while (!candidates.empty()) {
+    const Entry current = candidates.top();
+    if (int32_t(best.size()) >= ef && current.first < best.top().first) {
+      break;
+    }
+    candidates.pop();
+    const int32_t* neighbors = links(current.second, level);
+    for (int32_t j = 0; j < maxLinks(level) && neighbors[j] >= 0; j++) {
+      const int32_t neighbor = neighbors[j];
+      if (!visited.insert(neighbor)) {
+        continue;
+      }
+      const real s = similarity(query, neighbor);
+      if (int32_t(best.size()) < ef || s > best.top().first) {
+        candidates.emplace(s, neighbor);
+        best.emplace(s, neighbor);
+        if (int32_t(best.size()) > ef) {
+          best.pop();
+        }
+      }
+    }
+  }
+  nearest.resize(best.size());
+  for (int64_t i = nearest.size() - 1; i >= 0; i--) {
+    nearest[i] = best.top();
+    best.pop();
+  }
+}
+
+// Keeps a candidate only if it is closer to the base row than to every
+// candidate kept before it, which spreads the links in all directions.
+// candidates must be sorted best first.
+void HnswIndex::selectNeighbors(
+    const std::vector<std::pair<real, int32_t>>& candidates,
+    int32_t maxCount,
+    std::vector<int32_t>& selected) const {
+  const int64_t dim = vectors_->cols();
+  selected.clear();
+  for (const auto& candidate : candidates) {
+    if (int32_t(selected.size()) >= maxCount) {
+      break;
+    }
+    const real* row = vectors_->data() + candidate.second * dim;
+    bool keep = true;
+    for (int32_t other : selected) {
+      if (similarity(row, other) > candidate.first) {
+        keep = false;
+        break;
+      }
+    }
+    if (keep) {
+      selected.push_back(candidate.second);
+    }
+  }
+}
+
+void HnswIndex::addLink(int32_t row, int32_t neighbor, int32_t level) {
+  int32_t* neighbors = links(row, level);
+  const int32_t maxCount = maxLinks(level);
+  for (int32_t j = 0; j < maxCount; j++) {
+    if (neighbors[j] < 0) {
+      neighbors[j] = neighbor;
+      return;
+    }
+  }
+  const real* base = vectors_->data() + int64_t(row) * vectors_->cols();
+  std::vector<std::pair<real, int32_t>> candidates;
+  candidates.reserve(maxCount + 1);
+  candidates.emplace_back(similarity(base, neighbor), neighbor);
+  for (int32_t j = 0; j < maxCount; j++) {
+    candidates.emplace_back(similarity(base, neighbors[j]), neighbors[j]);
+  }
+  std::sort(candidates.rbegin(), candidates.rend());
+  std::vector<int32_t> selected;
+  selectNeighbors(candidates, maxCount, selected);
+  std::fill(neighbors, neighbors + maxCount, -1);
+  std::copy(selected.begin(), selected.end(), neighbors);
+}
+
+uint64_t HnswIndex::fingerprint(const DenseMatrix& vectors) {
+  uint64_t h = 14695981039346656037ULL;
+  auto mix = [&h](const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; i++) {
+      h = (h ^ bytes[i]) * 1099511628211ULL;
+    }
+  };
+  const int64_t m = vectors.rows(), n = vectors.cols();
+  mix(&m, sizeof(m));
+  mix(&n, sizeof(n));
+  const int64_t step = std::max(m / FINGERPRINT_ROWS, int64_t(1));
+  for (int64_t i = 0; i < m; i += step) {
+    mix(vectors.data() + i * n, n * sizeof(real));
+  }
+  return h;
+}
+
+void HnswIndex::build(const DenseMatrix& vectors) {
+  vectors_ = &vectors;
+  fingerprint_ = fingerprint(vectors);
+  const int64_t n = vectors.rows();
+  const int64_t dim = vectors.cols();
+  std::minstd_rand rng(1);
+  std::uniform_real_distribution<double> uniform(0.0, 1.0);
+  const double levelScale = 1.0 / std::log(double(m_));
+  levels_.resize(n);
+  upperLinks_.assign(n, std::vector<int32_t>());
+  links0_.assign(n * 2 * m_, -1);
+  for (int64_t i = 0; i < n; i++) {
+    levels_[i] = int32_t(-std::log(1.0 - uniform(rng)) * levelScale);
+    upperLinks_[i].assign(levels_[i] * m_, -1);
+  }
+  entryPoint_ = n > 0 ? 0 : -1;
+  maxLevel_ = n > 0 ? levels_[0] : -1;
+
+  VisitedSet visited(n);
+  std::vector<std::pair<real, int32_t>> nearest;
+  std::vector<int32_t> selected;
+  for (int32_t i = 1; i < n; i++) {
+    const real* query = vectors.data() + i * dim;
+    nearest.assign(1, {similarity(query, entryPoint_), entryPoint_});
+    for (int32_t level = maxLevel_; level > levels_[i]; level--) {
+      searchLayer(query, nearest, 1, level, visited);
+    }
+    for (int32_t level = std::min(levels_[i], maxLevel_); level >= 0;
+         level--) {
+      searchLayer(query, nearest, efConstruction_, level, visited);
+      selectNeighbors(nearest, m_, selected);
+      std::copy(selected.begin(), selected.end(), links(i, level));
+      for (int32_t neighbor : selected) {
+        addLink(neighbor, i, level);
+      }
+    }
+    if (levels_[i] > maxLevel_) {
+      maxLevel_ = levels_[i];
+      entryPoint_ = i;
+    }
+  }
+}
+
+void HnswIndex::save(std::ostream& out) const {
+  const int64_t n = levels_.size();
+  const int64_t dim = vectors_ ? vectors_->cols() : 0;
+  const int32_t version = VERSION;
+  out.write((char*)&version, sizeof(int32_t));
+  out.write((char*)&m_, sizeof(int32_t));
+  out.write((char*)&efConstruction_, sizeof(int32_t));
+  out.write((char*)&n, sizeof(int64_t));
+  out.write((char*)&dim, sizeof(int64_t));
+  out.write((char*)&fingerprint_, sizeof(uint64_t));
+  out.write((char*)&entryPoint_, sizeof(int32_t));
+  out.write((char*)&maxLevel_, sizeof(int32_t));
+  out.write((char*)levels_.data(), n * sizeof(int32_t));
+  out.write((char*)links0_.data(), links0_.size() * sizeof(int32_t));
+  for (const auto& upper : upperLinks_) {
+    out.write((char*)upper.data(), upper.size() * sizeof(int32_t));
+  }
+}
+
+void HnswIndex::load(std::istream& in, const DenseMatrix& vectors) {
+  int32_t version, m, efConstruction;
+  int64_t n, dim;
+  uint64_t fingerprint;
+  in.read((char*)&version, sizeof(int32_t));
+  if (!in || version != VERSION) {
+    throw std::invalid_argument("Unsupported nearest neighbor index.");
+  }
+  in.read((char*)&m, sizeof(int32_t));
+  in.read((char*)&efConstruction, sizeof(int32_t));
+  in.read((char*)&n, sizeof(int64_t));
+  in.read((char*)&dim, sizeof(int64_t));
+  in.read((char*)&fingerprint, sizeof(uint64_t));
+  if (!in || n != vectors.rows() || dim != vectors.cols() ||
+      fingerprint != HnswIndex::fingerprint(vectors)) {
+    throw std::invalid_argument(
+        "Nearest neighbor index does not match the word vectors.");
+  }
+  const std::invalid_argument invalid("Invalid nearest neighbor index.");
+  int32_t entryPoint, maxLevel;
+  in.read((char*)&entryPoint, sizeof(int32_t));
+  in.read((char*)&maxLevel, sizeof(int32_t));
+  if (!in || m <= 0 || efConstruction <= 0) {
+    throw invalid;
+  }
+  if (n == 0 && (entryPoint != -1 || maxLevel != -1)) {
+    throw invalid;
+  }
+  if (n > 0 &&
+      (entryPoint < 0 || entryPoint >= n || maxLevel < 0 ||
+       maxLevel > MAX_LEVEL)) {
+    throw invalid;
+  }
+  std::vector<int32_t> levels(n);
+  in.read((char*)levels.data(), n * sizeof(int32_t));
+  if (!in || (n > 0 && levels[entryPoint] != maxLevel)) {
+    throw invalid;
+  }
+  for (int32_t level : levels) {
+    if (level < 0 || level > maxLevel) {
+      throw invalid;
+    }
+  }
+  // a row linked on a layer is on that layer too
+  auto checkLinks = [&](const int32_t* links, int64_t count, int32_t level) {
+    for (int64_t j = 0; j < count; j++) {
+      if (links[j] < -1 || links[j] >= n ||
+          (links[j] >= 0 && levels[links[j]] < level)) {
+        throw invalid;
+      }
+    }
+  };
+  std::vector<int32_t> links0(n * 2 * m);
+  in.read((char*)links0.data(), links0.size() * sizeof(int32_t));
+  checkLinks(links0.data(), links0.size(), 0);
+  std::vector<std::vector<int32_t>> upperLinks(n);
+  for (int64_t i = 0; i < n && in; i++) {
+    upperLinks[i].resize(levels[i] * m);
+    in.read(
+        (char*)upperLinks[i].data(), upperLinks[i].size() * sizeof(int32_t));
+    for (int32_t level = 1; level <= levels[i]; level++) {
+      checkLinks(upperLinks[i].data() + (level - 1) * m, m, level);
+    }
+  }
+  if (!in) {
+    throw invalid;
+  }
+  m_ = m;
+  efConstruction_ = efConstruction;
+  vectors_ = &vectors;
+  fingerprint_ = fingerprint;
+  entryPoint_ = entryPoint;
+  maxLevel_ = maxLevel;
+  levels_.swap(levels);
+  links0_.swap(links0);
+  upperLinks_.swap(upperLinks);
+}
+
+VisitedSet::VisitedSet(int64_t n) : stamps_(n, 0), stamp_(0) {}
+
+void VisitedSet::resize(int64_t n) {
+  stamps_.assign(n, 0);
+  stamp_ = 0;
+}
+
+void VisitedSet::clear() {
+  stamp_++;
+  if (stamp_ == 0) {
+    // the stamps wrapped around, older marks could match again
+    std::fill(stamps_.begin(), stamps_.end(), 0);
+    stamp_ = 1;
+  }
+}
+
+std::vector<std::pair<real, int32_t>> HnswIndex::search(
+    const Vector& query,
+    int32_t k,
+    int32_t ef,
+    VisitedSet& visited) const {
+  std::vector<std::pair<real, int32_t>> nearest;
+  if (entryPoint_ < 0 || k <= 0) {
+    return nearest;
+  }
+  if (visited.size() != int64_t(levels_.size())) {
+    visited.resize(levels_.size());
+  }
+  nearest.assign(1, {similarity(query.data(), entryPoint_), entryPoint_});
+  for (int32_t level = maxLevel_; level > 0; level--) {
+    searchLayer(query.data(), nearest, 1, level, visited);
+  }
+  searchLayer(query.data(), nearest, std::max(ef, k), 0, visited);
+  if (int32_t(nearest.size()) > k) {
+    nearest.resize(k);
+  }
+  return nearest;
+}
+
+} // namespace fasttext
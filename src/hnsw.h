@@ -0,0 +1,112 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "densematrix.h"
+#include "real.h"
+#include "vector.h"
+
+namespace fasttext {
+
+// Rows seen by a search of a layer, stamped with the number of the search
+// so that the marks never need to be cleared between layers, rows or
+// queries. Keeping one set between queries saves allocating and zeroing a
+// mark per row for each of them.
+class VisitedSet {
+ protected:
+  std::vector<uint32_t> stamps_;
+  uint32_t stamp_;
+
+ public:
+  explicit VisitedSet(int64_t n = 0);
+
+  inline int64_t size() const {
+    return stamps_.size();
+  }
+  // Makes room for n rows, none of them seen.
+  void resize(int64_t n);
+  // Starts a new search.
+  void clear();
+
+  inline bool insert(int32_t row) {
+    if (stamps_[row] == stamp_) {
+      return false;
+    }
+    stamps_[row] = stamp_;
+    return true;
+  }
+};
+
+// Hierarchical navigable small world graph over the rows of a matrix, for
+// approximate maximum inner product search. Every row is linked to about
+// m of its nearest rows (2m on the bottom layer), and a few rows are also
+// linked on sparser upper layers, which a search walks down greedily
+// before exploring the bottom layer.
+class HnswIndex {
+ protected:
+  static const int32_t VERSION = 1;
+
+  int32_t m_;
+  int32_t efConstruction_;
+  int32_t entryPoint_;
+  int32_t maxLevel_;
+  uint64_t fingerprint_;
+  const DenseMatrix* vectors_;
+  // Top layer of every row.
+  std::vector<int32_t> levels_;
+  // Neighbors of row i on the bottom layer are at [i * 2m, (i + 1) * 2m),
+  // on layer l > 0 at [(l - 1) * m, l * m) of upperLinks_[i]. Unused
+  // slots are -1.
+  std::vector<int32_t> links0_;
+  std::vector<std::vector<int32_t>> upperLinks_;
+
+  real similarity(const real* query, int32_t row) const;
+  int32_t maxLinks(int32_t level) const;
+  int32_t* links(int32_t row, int32_t level);
+  const int32_t* links(int32_t row, int32_t level) const;
+  template <typename Visited>
+  void searchLayer(
+      const real* query,
+      std::vector<std::pair<real, int32_t>>& nearest,
+      int32_t ef,
+      int32_t level,
+      Visited& visited) const;
+  void selectNeighbors(
+      const std::vector<std::pair<real, int32_t>>& candidates,
+      int32_t maxCount,
+      std::vector<int32_t>& selected) const;
+  void addLink(int32_t row, int32_t neighbor, int32_t level);
+  static uint64_t fingerprint(const DenseMatrix& vectors);
+
+ public:
+  explicit HnswIndex(int32_t m = 16, int32_t efConstruction = 100);
+
+  void build(const DenseMatrix& vectors);
+  void save(std::ostream& out) const;
+  // Throws if the index was not built from these vectors.
+  void load(std::istream& in, const DenseMatrix& vectors);
+
+  // Returns up to k rows by decreasing dot product with query, together
+  // with the dot products. ef is the number of candidates kept during the
+  // search: larger values find more of the exact neighbors but are slower.
+  // visited is resized to the number of rows if needed.
+  std::vector<std::pair<real, int32_t>> search(
+      const Vector& query,
+      int32_t k,
+      int32_t ef,
+      VisitedSet& visited) const;
+};
+
+} // namespace fasttext
@@ -7,15 +7,22 @@
  */
 
 #include "loss.h"
+#include "mappedmatrix.h"
+#include "simd.h"
 #include "utils.h"
 
+#include <algorithm>
 #include <cmath>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
 
 namespace fasttext {
 
 constexpr int64_t SIGMOID_TABLE_SIZE = 512;
 constexpr int64_t MAX_SIGMOID = 8;
 constexpr int64_t LOG_TABLE_SIZE = 512;
+constexpr real LEVEL_SLACK = 1e-4;
 
 bool comparePairs(
     const std::pair<real, int32_t>& l,
@@ -41,8 +48,14 @@ Loss::Loss(std::shared_ptr<Matrix>& wo) : wo_(wo) {
   }
 }
 
+// The sampled rows kernel, Matrix::dotRows, does not look for NaN, so it is
+// caught here, before it would be turned into a table index. Written so
+// that ordinary values take the same comparisons as before.
 real Loss::log(real x) const {
-  if (x > 1.0) {
+  if (!(x <= 1.0)) {
+    if (std::isnan(x)) {
+      throw std::runtime_error("Encountered NaN.");
+    }
     return 0.0;
   }
   int64_t i = int64_t(x * LOG_TABLE_SIZE);
@@ -50,7 +63,10 @@ real Loss::log(real x) const {
 }
 
 real Loss::sigmoid(real x) const {
-  if (x < -MAX_SIGMOID) {
+  if (!(x >= -MAX_SIGMOID)) {
+    if (std::isnan(x)) {
+      throw std::runtime_error("Encountered NaN.");
+    }
     return 0.0;
   } else if (x > MAX_SIGMOID) {
     return 1.0;
@@ -67,8 +83,7 @@ void Loss::predict(
     Predictions& heap,
     Model::State& state) const {
   computeOutput(state);
-  findKBest(k, threshold, heap, state.output);
-  std::sort_heap(heap.begin(), heap.end(), comparePairs);
+  findKBest(k, threshold, heap, state.output, state.topk);
 }
 
 void Loss::predict(Predictions& predictions, Model::State& state) const {
@@ -80,24 +95,39 @@ void Loss::predict(Predictions& predictions, Model::State& state) const {
   }
 }
 
+void Loss::predict(
+    int32_t k,
+    real threshold,
+    const DenseMatrix& hidden,
+    std::vector<Predictions>& heaps,
+    Model::State& state) const {
+  const int64_t nrows = hidden.size(0);
+  const int64_t osz = wo_->size(0);
+  assert(heaps.size() == nrows);
+  DenseMatrix& scores = state.batchScores;
+  scores.resize(nrows, osz);
+  wo_->gemm(hidden, scores);
+  Vector& output = state.output;
+  for (int64_t b = 0; b < nrows; b++) {
+    std::copy(
+        scores.data() + b * osz,
+        scores.data() + (b + 1) * osz,
+        output.data());
+    activate(output);
+    findKBest(k, threshold, heaps[b], output, state.topk);
+  }
+}
+
+// Appends the k best predictions, best first. The log is only taken for
+// the selected outputs.
 void Loss::findKBest(
     int32_t k,
     real threshold,
     Predictions& heap,
-    const Vector& output) const {
-  for (int32_t i = 0; i < output.size(); i++) {
-    if (output[i] < threshold) {
-      continue;
-    }
-    if (heap.size() == k && std_log(output[i]) < heap.front().first) {
-      continue;
-    }
+    const Vector& output,
+    TopK& topk) const {
+  for (int32_t i : topk.select(output.data(), output.size(), k, threshold)) {
     heap.emplace_back(std_log(output[i]), i);
-    std::push_heap(heap.begin(), heap.end(), comparePairs);
-    if (heap.size() > k) {
-      std::pop_heap(heap.begin(), heap.end(), comparePairs);
-      heap.pop_back();
-    }
   }
 }
 
@@ -123,17 +153,63 @@ real BinaryLogisticLoss::binaryLogistic(
   }
 }
 
+// A row drawn twice must be scored after its first update, so the rows go
+// in runs without repeats.
+real BinaryLogisticLoss::binaryLogistic(
+    const std::vector<int32_t>& rows,
+    int64_t npositives,
+    Model::State& state,
+    real lr,
+    bool backprop) const {
+  std::vector<real>& scores = state.scores;
+  scores.resize(rows.size());
+  real loss = 0.0;
+  for (auto begin = rows.begin(); begin != rows.end();) {
+    auto end = begin + 1;
+    while (end != rows.end() && std::find(begin, end, *end) == end) {
+      end++;
+    }
+    const int64_t offset = begin - rows.begin();
+    const int64_t m = end - begin;
+    real* alpha = scores.data() + offset;
+    wo_->dotRows(state.hidden, rows.data() + offset, m, alpha);
+    for (int64_t j = 0; j < m; j++) {
+      const bool labelIsPositive = offset + j < npositives;
+      real score = sigmoid(alpha[j]);
+      alpha[j] = lr * (real(labelIsPositive) - score);
+      if (labelIsPositive) {
+        loss += -log(score);
+      } else {
+        loss += -log(1.0 - score);
+      }
+    }
+    if (backprop) {
+      wo_->updateRows(
+          state.hidden, rows.data() + offset, alpha, m, state.grad);
+    }
+    begin = end;
+  }
+  return loss;
+}
+
 void BinaryLogisticLoss::computeOutput(Model::State& state) const {
-  Vector& output = state.output;
-  output.mul(*wo_, state.hidden);
+  state.output.mul(*wo_, state.hidden);
+  activate(state.output);
+}
+
+void BinaryLogisticLoss::activate(Vector& output) const {
   int32_t osz = output.size();
   for (int32_t i = 0; i < osz; i++) {
     output[i] = sigmoid(output[i]);
   }
 }
 
-OneVsAllLoss::OneVsAllLoss(std::shared_ptr<Matrix>& wo)
-    : BinaryLogisticLoss(wo) {}
+OneVsAllLoss::OneVsAllLoss(
+    std::shared_ptr<Matrix>& wo,
+    int neg,
+    sampler_name sampler,
+    const std::vector<int64_t>& targetCounts)
+    : BinaryLogisticLoss(wo), neg_(neg), sampler_(sampler, targetCounts) {}
 
 real OneVsAllLoss::forward(
     const std::vector<int32_t>& targets,
@@ -141,34 +217,59 @@ real OneVsAllLoss::forward(
     Model::State& state,
     real lr,
     bool backprop) {
+  std::vector<int32_t>& samples = state.samples;
+  samples.assign(targets.begin(), targets.end());
+  std::sort(samples.begin(), samples.end());
+  samples.erase(std::unique(samples.begin(), samples.end()), samples.end());
+
+  if (neg_ > 0) {
+    sampler_.build();
+    const int64_t npositives = samples.size();
+    // when every label is a positive, there is no negative to sample
+    const int32_t nnegatives = npositives < wo_->size(0) ? neg_ : 0;
+    for (int32_t n = 0; n < nnegatives; n++) {
+      int32_t negative;
+      do {
+        negative = sampler_.sample(state.rng);
+      } while (std::binary_search(
+          samples.begin(), samples.begin() + npositives, negative));
+      samples.push_back(negative);
+    }
+    return binaryLogistic(samples, npositives, state, lr, backprop);
+  }
+
+  // Rows do not depend on each other's updates, so all of them are scored
+  // at once, then updated at once, in the same order as one at a time.
   real loss = 0.0;
   int32_t osz = state.output.size();
+  state.output.mul(*wo_, state.hidden);
+  auto positive = samples.begin();
   for (int32_t i = 0; i < osz; i++) {
-    bool isMatch = utils::contains(targets, i);
-    loss += binaryLogistic(i, state, isMatch, lr, backprop);
+    bool isMatch = positive != samples.end() && *positive == i;
+    positive += isMatch;
+    real score = sigmoid(state.output[i]);
+    state.output[i] = lr * (real(isMatch) - score);
+    if (isMatch) {
+      loss += -log(score);
+    } else {
+      loss += -log(1.0 - score);
+    }
+  }
+  if (backprop) {
+    samples.resize(osz);
+    std::iota(samples.begin(), samples.end(), 0);
+    wo_->updateRows(
+        state.hidden, samples.data(), state.output.data(), osz, state.grad);
   }
-
   return loss;
 }
 
 NegativeSamplingLoss::NegativeSamplingLoss(
     std::shared_ptr<Matrix>& wo,
     int neg,
+    sampler_name sampler,
     const std::vector<int64_t>& targetCounts)
-    : BinaryLogisticLoss(wo), neg_(neg), negatives_(), uniform_() {
-  real z = 0.0;
-  for (size_t i = 0; i < targetCounts.size(); i++) {
-    z += pow(targetCounts[i], 0.5);
-  }
-  for (size_t i = 0; i < targetCounts.size(); i++) {
-    real c = pow(targetCounts[i], 0.5);
-    for (size_t j = 0; j < c * NegativeSamplingLoss::NEGATIVE_TABLE_SIZE / z;
-         j++) {
-      negatives_.push_back(i);
-    }
-  }
-  uniform_ = std::uniform_int_distribution<size_t>(0, negatives_.size() - 1);
-}
+    : BinaryLogisticLoss(wo), neg_(neg), sampler_(sampler, targetCounts) {}
 
 real NegativeSamplingLoss::forward(
     const std::vector<int32_t>& targets,
@@ -178,14 +279,14 @@ real NegativeSamplingLoss::forward(
     bool backprop) {
   assert(targetIndex >= 0);
   assert(targetIndex < targets.size());
+  sampler_.build();
   int32_t target = targets[targetIndex];
-  real loss = binaryLogistic(target, state, true, lr, backprop);
-
+  std::vector<int32_t>& samples = state.samples;
+  samples.assign(1, target);
   for (int32_t n = 0; n < neg_; n++) {
-    auto negativeTarget = getNegative(target, state.rng);
-    loss += binaryLogistic(negativeTarget, state, false, lr, backprop);
+    samples.push_back(getNegative(target, state.rng));
   }
-  return loss;
+  return binaryLogistic(samples, 1, state, lr, backprop);
 }
 
 int32_t NegativeSamplingLoss::getNegative(
@@ -193,7 +294,7 @@ int32_t NegativeSamplingLoss::getNegative(
     std::minstd_rand& rng) {
   int32_t negative;
   do {
-    negative = negatives_[uniform_(rng)];
+    negative = sampler_.sample(rng);
   } while (target == negative);
   return negative;
 }
@@ -202,10 +303,12 @@ HierarchicalSoftmaxLoss::HierarchicalSoftmaxLoss(
     std::shared_ptr<Matrix>& wo,
     const std::vector<int64_t>& targetCounts)
     : BinaryLogisticLoss(wo),
-      paths_(),
-      codes_(),
+      pathOffsets_(),
+      pathNodes_(),
+      pathCodes_(),
       tree_(),
-      osz_(targetCounts.size()) {
+      osz_(targetCounts.size()),
+      ntopRows_(0) {
   buildTree(targetCounts);
 }
 
@@ -217,6 +320,7 @@ void HierarchicalSoftmaxLoss::buildTree(const std::vector<int64_t>& counts) {
     tree_[i].right = -1;
     tree_[i].count = 1e15;
     tree_[i].binary = false;
+    tree_[i].height = 0;
   }
   for (int32_t i = 0; i < osz_; i++) {
     tree_[i].count = counts[i];
@@ -238,19 +342,83 @@ void HierarchicalSoftmaxLoss::buildTree(const std::vector<int64_t>& counts) {
     tree_[mini[0]].parent = i;
     tree_[mini[1]].parent = i;
     tree_[mini[1]].binary = true;
+    tree_[i].height =
+        1 + std::max(tree_[mini[0]].height, tree_[mini[1]].height);
   }
+  pathOffsets_.assign(osz_ + 1, 0);
   for (int32_t i = 0; i < osz_; i++) {
-    std::vector<int32_t> path;
-    std::vector<bool> code;
-    int32_t j = i;
-    while (tree_[j].parent != -1) {
-      path.push_back(tree_[j].parent - osz_);
-      code.push_back(tree_[j].binary);
-      j = tree_[j].parent;
+    int64_t depth = 0;
+    for (int32_t j = i; tree_[j].parent != -1; j = tree_[j].parent) {
+      depth++;
     }
-    paths_.push_back(std::move(path));
-    codes_.push_back(std::move(code));
+    pathOffsets_[i + 1] = pathOffsets_[i] + depth;
+  }
+  pathNodes_.resize(pathOffsets_[osz_]);
+  pathCodes_.resize(pathOffsets_[osz_]);
+  for (int32_t i = 0; i < osz_; i++) {
+    int64_t offset = pathOffsets_[i];
+    for (int32_t j = i; tree_[j].parent != -1; j = tree_[j].parent) {
+      pathNodes_[offset] = tree_[j].parent - osz_;
+      pathCodes_[offset] = tree_[j].binary;
+      offset++;
+    }
+  }
+  bfsPosition_.assign(osz_ - 1, -1);
+  if (osz_ < 2) {
+    // a single label is a leaf root without inner nodes
+    return;
+  }
+  std::vector<int32_t> queue(1, 2 * osz_ - 2);
+  for (size_t i = 0; i < queue.size(); i++) {
+    const Node& n = tree_[queue[i]];
+    bfsPosition_[queue[i] - osz_] = i;
+    for (int32_t child : {n.left, n.right}) {
+      if (child >= osz_) {
+        queue.push_back(child);
+      }
+    }
+  }
+}
+
+void HierarchicalSoftmaxLoss::buildTopRows() const {
+  const real* rows = nullptr;
+  if (auto dense = dynamic_cast<const DenseMatrix*>(wo_.get())) {
+    rows = dense->data();
+  } else if (auto mapped = dynamic_cast<const MappedMatrix*>(wo_.get())) {
+    rows = mapped->data();
+  } else {
+    // quantized rows are scored by the matrix itself
+    return;
+  }
+  const int64_t dim = wo_->size(1);
+  ntopRows_ = std::min(
+      int64_t(osz_ - 1), TOP_ROWS_BYTES / int64_t(dim * sizeof(real)));
+  topRows_.resize(ntopRows_ * dim);
+  for (int32_t i = 0; i < osz_ - 1; i++) {
+    const int64_t position = bfsPosition_[i];
+    if (position < ntopRows_) {
+      std::copy(
+          rows + i * dim,
+          rows + (i + 1) * dim,
+          topRows_.data() + position * dim);
+    }
+  }
+}
+
+real HierarchicalSoftmaxLoss::nodeProbability(
+    int32_t node,
+    const Vector& hidden) const {
+  const int64_t position = bfsPosition_[node - osz_];
+  real f;
+  if (position < ntopRows_) {
+    f = simd::dot(
+        topRows_.data() + position * hidden.size(),
+        hidden.data(),
+        hidden.size());
+  } else {
+    f = wo_->dotRow(hidden, node - osz_);
   }
+  return 1. / (1 + std::exp(-f));
 }
 
 real HierarchicalSoftmaxLoss::forward(
@@ -261,83 +429,120 @@ real HierarchicalSoftmaxLoss::forward(
     bool backprop) {
   real loss = 0.0;
   int32_t target = targets[targetIndex];
-  const std::vector<bool>& binaryCode = codes_[target];
-  const std::vector<int32_t>& pathToRoot = paths_[target];
-  for (int32_t i = 0; i < pathToRoot.size(); i++) {
-    loss += binaryLogistic(pathToRoot[i], state, binaryCode[i], lr, backprop);
+  const int64_t end = pathOffsets_[target + 1];
+  for (int64_t i = pathOffsets_[target]; i < end; i++) {
+    loss += binaryLogistic(pathNodes_[i], state, pathCodes_[i], lr, backprop);
   }
   return loss;
 }
 
+// Best-first search: the node with the highest bound on the score of its
+// leaves is expanded next, so leaves come out best first and the search
+// stops after k of them. A step adds std_log(f) <= log(1 + 1e-5) to the
+// score, so a node's bound is its score plus a small slack per level below
+// it, which also covers the rounding of the additions.
 void HierarchicalSoftmaxLoss::predict(
     int32_t k,
     real threshold,
     Predictions& heap,
     Model::State& state) const {
-  dfs(k, threshold, 2 * osz_ - 2, 0.0, heap, state.hidden);
-  std::sort_heap(heap.begin(), heap.end(), comparePairs);
+  std::call_once(topRowsOnce_, [this]() { buildTopRows(); });
+  const real minScore = std_log(threshold);
+  auto bound = [this](const std::pair<real, int32_t>& entry) {
+    return entry.first + LEVEL_SLACK * tree_[entry.second].height;
+  };
+  auto lowerBound = [&bound](
+                        const std::pair<real, int32_t>& l,
+                        const std::pair<real, int32_t>& r) {
+    return bound(l) < bound(r);
+  };
+
+  Predictions& frontier = state.frontier;
+  frontier.clear();
+  if (0.0 >= minScore) {
+    frontier.emplace_back(0.0, 2 * osz_ - 2);
+  }
+  int32_t found = 0;
+  while (!frontier.empty() && found < k) {
+    std::pop_heap(frontier.begin(), frontier.end(), lowerBound);
+    const real score = frontier.back().first;
+    const int32_t node = frontier.back().second;
+    frontier.pop_back();
+
+    if (tree_[node].left == -1 && tree_[node].right == -1) {
+      heap.emplace_back(score, node);
+      found++;
+      continue;
+    }
+    const real f = nodeProbability(node, state.hidden);
+    const real left = score + std_log(1.0 - f);
+    const real right = score + std_log(f);
+    if (left >= minScore) {
+      frontier.emplace_back(left, tree_[node].left);
+      std::push_heap(frontier.begin(), frontier.end(), lowerBound);
+    }
+    if (right >= minScore) {
+      frontier.emplace_back(right, tree_[node].right);
+      std::push_heap(frontier.begin(), frontier.end(), lowerBound);
+    }
+  }
 }
 
 void HierarchicalSoftmaxLoss::predict(Predictions& predictions, Model::State& state) const {
-  dfs(2 * osz_ - 2, 0.0, predictions, state.hidden);
+  std::call_once(topRowsOnce_, [this]() { buildTopRows(); });
+  dfs(2 * osz_ - 2, predictions, state);
 }
 
-
-
-void HierarchicalSoftmaxLoss::dfs(
+void HierarchicalSoftmaxLoss::predict(
     int32_t k,
     real threshold,
-    int32_t node,
-    real score,
-    Predictions& heap,
-    const Vector& hidden) const {
-  if (score < std_log(threshold)) {
-    return;
-  }
-  if (heap.size() == k && score < heap.front().first) {
-    return;
-  }
-
-  if (tree_[node].left == -1 && tree_[node].right == -1) {
-    heap.emplace_back(score, node);
-    std::push_heap(heap.begin(), heap.end(), comparePairs);
-    if (heap.size() > k) {
-      std::pop_heap(heap.begin(), heap.end(), comparePairs);
-      heap.pop_back();
-    }
-    return;
+    const DenseMatrix& hidden,
+    std::vector<Predictions>& heaps,
+    Model::State& state) const {
+  const int64_t dim = hidden.size(1);
+  assert(heaps.size() == hidden.size(0));
+  for (int64_t b = 0; b < hidden.size(0); b++) {
+    std::copy(
+        hidden.data() + b * dim,
+        hidden.data() + (b + 1) * dim,
+        state.hidden.data());
+    predict(k, threshold, heaps[b], state);
   }
+}
 
-  real f = wo_->dotRow(hidden, node - osz_);
-  f = 1. / (1 + std::exp(-f));
 
-  dfs(k, threshold, tree_[node].left, score + std_log(1.0 - f), heap, hidden);
-  dfs(k, threshold, tree_[node].right, score + std_log(f), heap, hidden);
-}
 
+// Scores every leaf, left subtrees first, with an explicit stack.
 void HierarchicalSoftmaxLoss::dfs(
     int32_t node,
-    real score,
     Predictions& predictions,
-    const Vector& hidden) const {
-
-  if (tree_[node].left == -1 && tree_[node].right == -1) {
-    predictions.emplace_back(score, node);
-    return;
+    Model::State& state) const {
+  Predictions& stack = state.frontier;
+  stack.clear();
+  stack.emplace_back(0.0, node);
+  while (!stack.empty()) {
+    const real score = stack.back().first;
+    node = stack.back().second;
+    stack.pop_back();
+
+    if (tree_[node].left == -1 && tree_[node].right == -1) {
+      predictions.emplace_back(score, node);
+      continue;
+    }
+    const real f = nodeProbability(node, state.hidden);
+    stack.emplace_back(score + std_log(f), tree_[node].right);
+    stack.emplace_back(score + std_log(1.0 - f), tree_[node].left);
   }
-
-  real f = wo_->dotRow(hidden, node - osz_);
-  f = 1. / (1 + std::exp(-f));
-
-  dfs(tree_[node].left, score + std_log(1.0 - f), predictions, hidden);
-  dfs(tree_[node].right, score + std_log(f), predictions, hidden);
 }
 
 SoftmaxLoss::SoftmaxLoss(std::shared_ptr<Matrix>& wo) : Loss(wo) {}
 
 void SoftmaxLoss::computeOutput(Model::State& state) const {
-  Vector& output = state.output;
-  output.mul(*wo_, state.hidden);
+  state.output.mul(*wo_, state.hidden);
+  activate(state.output);
+}
+
+void SoftmaxLoss::activate(Vector& output) const {
   real max = output[0], z = 0.0;
   int32_t osz = output.size();
   for (int32_t i = 0; i < osz; i++) {
@@ -376,4 +581,62 @@ real SoftmaxLoss::forward(
   return -log(state.output[target]);
 };
 
+SampledSoftmaxLoss::SampledSoftmaxLoss(
+    std::shared_ptr<Matrix>& wo,
+    int neg,
+    sampler_name sampler,
+    const std::vector<int64_t>& targetCounts)
+    : SoftmaxLoss(wo), neg_(neg), sampler_(sampler, targetCounts) {}
+
+// Scores are corrected by -log(neg * q), q being the probability of the
+// candidate under the sampler. Candidates equal to the target are left
+// out of the softmax.
+real SampledSoftmaxLoss::forward(
+    const std::vector<int32_t>& targets,
+    int32_t targetIndex,
+    Model::State& state,
+    real lr,
+    bool backprop) {
+  assert(targetIndex >= 0);
+  assert(targetIndex < targets.size());
+  sampler_.build();
+  int32_t target = targets[targetIndex];
+  std::vector<int32_t>& samples = state.samples;
+  std::vector<real>& scores = state.scores;
+  samples.assign(1, target);
+  for (int32_t n = 0; n < neg_; n++) {
+    samples.push_back(sampler_.sample(state.rng));
+  }
+  const int64_t m = samples.size();
+  scores.resize(m);
+  wo_->dotRows(state.hidden, samples.data(), m, scores.data());
+
+  real max = -std::numeric_limits<real>::infinity(), z = 0.0;
+  for (int64_t j = 0; j < m; j++) {
+    if (j > 0 && samples[j] == target) {
+      scores[j] = -std::numeric_limits<real>::infinity();
+    } else {
+      scores[j] -= std::log(neg_ * sampler_.probability(samples[j]));
+    }
+    max = std::max(scores[j], max);
+  }
+  for (int64_t j = 0; j < m; j++) {
+    scores[j] = exp(scores[j] - max);
+    z += scores[j];
+  }
+  for (int64_t j = 0; j < m; j++) {
+    scores[j] /= z;
+  }
+  real loss = -log(scores[0]);
+
+  if (backprop) {
+    for (int64_t j = 0; j < m; j++) {
+      real label = (j == 0) ? 1.0 : 0.0;
+      scores[j] = lr * (label - scores[j]);
+    }
+    wo_->updateRows(state.hidden, samples.data(), scores.data(), m, state.grad);
+  }
+  return loss;
+}
+
 } // namespace fasttext
@@ -9,12 +9,16 @@
 #pragma once
 
 #include <memory>
+#include <mutex>
 #include <random>
 #include <vector>
 
+#include "args.h"
+#include "densematrix.h"
 #include "matrix.h"
 #include "model.h"
 #include "real.h"
+#include "sampler.h"
 #include "utils.h"
 #include "vector.h"
 
@@ -26,7 +30,8 @@ class Loss {
       int32_t k,
       real threshold,
       Predictions& heap,
-      const Vector& output) const;
+      const Vector& output,
+      TopK& topk) const;
 
  protected:
   std::vector<real> t_sigmoid_;
@@ -35,6 +40,8 @@ class Loss {
 
   real log(real x) const;
   real sigmoid(real x) const;
+  // Turns the scores of the output layer into probabilities, in place.
+  virtual void activate(Vector& output) const = 0;
 
  public:
   explicit Loss(std::shared_ptr<Matrix>& wo);
@@ -55,6 +62,15 @@ class Loss {
       Model::State& /*state*/) const;
 
   virtual void predict(Predictions& predictions, Model::State& state) const;
+
+  // Predicts for every row of hidden. All rows are scored with a single
+  // Matrix::gemm, which reads wo_ once for the whole batch.
+  virtual void predict(
+      int32_t k,
+      real threshold,
+      const DenseMatrix& hidden,
+      std::vector<Predictions>& heaps,
+      Model::State& state) const;
 };
 
 class BinaryLogisticLoss : public Loss {
@@ -65,6 +81,16 @@ class BinaryLogisticLoss : public Loss {
       bool labelIsPositive,
       real lr,
       bool backprop) const;
+  // Same as binaryLogistic on every row in order, the first npositives
+  // rows being the positive ones, with one dotRows and one updateRows for
+  // each run of distinct rows. Uses state.scores.
+  real binaryLogistic(
+      const std::vector<int32_t>& rows,
+      int64_t npositives,
+      Model::State& state,
+      real lr,
+      bool backprop) const;
+  void activate(Vector& output) const override final;
 
  public:
   explicit BinaryLogisticLoss(std::shared_ptr<Matrix>& wo);
@@ -72,9 +98,19 @@ class BinaryLogisticLoss : public Loss {
   void computeOutput(Model::State& state) const override;
 };
 
+// With neg > 0, an update only touches the positive labels and neg
+// negatives drawn from a sampler, instead of every label.
 class OneVsAllLoss : public BinaryLogisticLoss {
+ protected:
+  int neg_;
+  Sampler sampler_;
+
  public:
-  explicit OneVsAllLoss(std::shared_ptr<Matrix>& wo);
+  explicit OneVsAllLoss(
+      std::shared_ptr<Matrix>& wo,
+      int neg,
+      sampler_name sampler,
+      const std::vector<int64_t>& targetCounts);
   ~OneVsAllLoss() noexcept override final = default;
   real forward(
       const std::vector<int32_t>& targets,
@@ -86,17 +122,16 @@ class OneVsAllLoss : public BinaryLogisticLoss {
 
 class NegativeSamplingLoss : public BinaryLogisticLoss {
  protected:
-  static const int32_t NEGATIVE_TABLE_SIZE = 10000000;
-
   int neg_;
-  std::vector<int32_t> negatives_;
-  std::uniform_int_distribution<size_t> uniform_;
+  Sampler sampler_;
+
   int32_t getNegative(int32_t target, std::minstd_rand& rng);
 
  public:
   explicit NegativeSamplingLoss(
       std::shared_ptr<Matrix>& wo,
       int neg,
+      sampler_name sampler,
       const std::vector<int64_t>& targetCounts);
   ~NegativeSamplingLoss() noexcept override final = default;
 
@@ -110,28 +145,37 @@ class NegativeSamplingLoss : public BinaryLogisticLoss {
 
 class HierarchicalSoftmaxLoss : public BinaryLogisticLoss {
  protected:
+  static const int64_t TOP_ROWS_BYTES = 256 * 1024;
+
   struct Node {
     int32_t parent;
     int32_t left;
     int32_t right;
     int64_t count;
     bool binary;
+    int32_t height;
   };
 
-  std::vector<std::vector<int32_t>> paths_;
-  std::vector<std::vector<bool>> codes_;
+  // Path of every leaf to the root, flattened: the internal nodes and
+  // codes of leaf i are at [pathOffsets_[i], pathOffsets_[i + 1]).
+  std::vector<int64_t> pathOffsets_;
+  std::vector<int32_t> pathNodes_;
+  std::vector<uint8_t> pathCodes_;
   std::vector<Node> tree_;
   int32_t osz_;
-  void buildTree(const std::vector<int64_t>& counts);
-  void dfs(
-      int32_t k,
-      real threshold,
-      int32_t node,
-      real score,
-      Predictions& heap,
-      const Vector& hidden) const;
+  // Breadth-first position of every internal node.
+  std::vector<int32_t> bfsPosition_;
+  // Copy of the output rows of the first internal nodes in breadth-first
+  // order, which every search goes through. Taken at the first prediction,
+  // once training is over.
+  mutable std::once_flag topRowsOnce_;
+  mutable std::vector<real> topRows_;
+  mutable int64_t ntopRows_;
 
-  void dfs(int32_t node, real score, Predictions& predictions, const Vector& hidden) const;
+  void buildTree(const std::vector<int64_t>& counts);
+  void buildTopRows() const;
+  real nodeProbability(int32_t node, const Vector& hidden) const;
+  void dfs(int32_t node, Predictions& predictions, Model::State& state) const;
 
  public:
   explicit HierarchicalSoftmaxLoss(
@@ -151,12 +195,24 @@ class HierarchicalSoftmaxLoss : public BinaryLogisticLoss {
       Model::State& state) const override final;
 
   void predict(Predictions& predictions, Model::State& state) const override final;
+
+  // The tree is walked per row: only the nodes on the best paths are
+  // scored, which is cheaper than any full product with wo_.
+  void predict(
+      int32_t k,
+      real threshold,
+      const DenseMatrix& hidden,
+      std::vector<Predictions>& heaps,
+      Model::State& state) const override final;
 };
 
 class SoftmaxLoss : public Loss {
+ protected:
+  void activate(Vector& output) const override final;
+
  public:
   explicit SoftmaxLoss(std::shared_ptr<Matrix>& wo);
-  ~SoftmaxLoss() noexcept override final = default;
+  ~SoftmaxLoss() noexcept override = default;
   real forward(
       const std::vector<int32_t>& targets,
       int32_t targetIndex,
@@ -166,4 +222,28 @@ class SoftmaxLoss : public Loss {
   void computeOutput(Model::State& state) const override final;
 };
 
+// Softmax over the target and neg candidates drawn from a sampler, whose
+// scores are corrected by the log of their expected count, so that the
+// cost of an update does not depend on the number of labels. Predictions
+// use the full softmax.
+class SampledSoftmaxLoss : public SoftmaxLoss {
+ protected:
+  int neg_;
+  Sampler sampler_;
+
+ public:
+  explicit SampledSoftmaxLoss(
+      std::shared_ptr<Matrix>& wo,
+      int neg,
+      sampler_name sampler,
+      const std::vector<int64_t>& targetCounts);
+  ~SampledSoftmaxLoss() noexcept override final = default;
+  real forward(
+      const std::vector<int32_t>& targets,
+      int32_t targetIndex,
+      Model::State& state,
+      real lr,
+      bool backprop) override final;
+};
+
 } // namespace fasttext
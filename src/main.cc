@@ -6,12 +6,14 @@
  * LICENSE file in the root directory of this source tree.
  */
 
+#include <cmath>
 #include <iomanip>
 #include <iostream>
 #include <queue>
 #include <stdexcept>
 #include "args.h"
 #include "fasttext.h"
+#include "simd.h"
 
 using namespace fasttext;
 
@@ -31,8 +33,11 @@ void printUsage() {
       << "  print-sentence-vectors  print sentence vectors given a trained model\n"
       << "  print-ngrams            print ngrams given a trained model and word\n"
       << "  nn                      query for nearest neighbors\n"
+      << "  nn-batch                nearest neighbors of every word of a file\n"
       << "  analogies               query for analogies\n"
       << "  dump                    dump arguments,dictionary,input/output vectors\n"
+      << "  convert                 convert a model to the aligned, mappable format\n"
+      << "  check-simd              check the vector kernels against the scalar ones\n"
       << std::endl;
 }
 
@@ -42,21 +47,23 @@ void printQuantizeUsage() {
 
 void printTestUsage() {
   std::cerr
-      << "usage: fasttext test <model> <test-data> [<k>] [<th>]\n\n"
+      << "usage: fasttext test <model> <test-data> [<k>] [<th>] [-thread <n>]\n\n"
       << "  <model>      model filename\n"
       << "  <test-data>  test data filename (if -, read from stdin)\n"
       << "  <k>          (optional; 1 by default) predict top k labels\n"
       << "  <th>         (optional; 0.0 by default) probability threshold\n"
+      << "  -thread <n>  (optional; 1 by default) number of threads\n"
       << std::endl;
 }
 
 void printPredictUsage() {
   std::cerr
-      << "usage: fasttext predict[-prob] <model> <test-data> [<k>] [<th>]\n\n"
+      << "usage: fasttext predict[-prob] <model> <test-data> [<k>] [<th>] [-thread <n>]\n\n"
       << "  <model>      model filename\n"
       << "  <test-data>  test data filename (if -, read from stdin)\n"
       << "  <k>          (optional; 1 by default) predict top k labels\n"
       << "  <th>         (optional; 0.0 by default) probability threshold\n"
+      << "  -thread <n>  (optional; 1 by default) number of threads, stdin is read line by line\n"
       << std::endl;
 }
 
@@ -106,16 +113,40 @@ void quantize(const std::vector<std::string>& args) {
 }
 
 void printNNUsage() {
-  std::cout << "usage: fasttext nn <model> <k>\n\n"
+  std::cout << "usage: fasttext nn <model> <k> <ef> [-thread <n>] "
+               "[-cache]\n\n"
             << "  <model>      model filename\n"
             << "  <k>          (optional; 10 by default) predict top k labels\n"
+            << "  <ef>         (optional; 0 by default) search an index\n"
+            << "               keeping ef candidates instead of all words,\n"
+            << "               cached in <model>.hnsw\n"
+            << "  -thread <n>  (optional; 1 by default) number of threads\n"
+            << "  -cache       (optional) keep the word vectors in <model>.wv\n"
             << std::endl;
 }
 
+void printNNBatchUsage() {
+  std::cout
+      << "usage: fasttext nn-batch <model> <queries> [<k>] [-thread <n>] "
+         "[-cache]\n\n"
+      << "  <model>      model filename\n"
+      << "  <queries>    words separated by whitespace (use '-' for stdin)\n"
+      << "  <k>          (optional; 10 by default) number of neighbors\n"
+      << "  -thread <n>  (optional; 1 by default) number of threads\n"
+      << "  -cache       (optional) keep the word vectors in <model>.wv\n"
+      << std::endl;
+}
+
 void printAnalogiesUsage() {
-  std::cout << "usage: fasttext analogies <model> <k>\n\n"
+  std::cout << "usage: fasttext analogies <model> <k> <ef> [-thread <n>] "
+               "[-cache]\n\n"
             << "  <model>      model filename\n"
             << "  <k>          (optional; 10 by default) predict top k labels\n"
+            << "  <ef>         (optional; 0 by default) search an index\n"
+            << "               keeping ef candidates instead of all words,\n"
+            << "               cached in <model>.hnsw\n"
+            << "  -thread <n>  (optional; 1 by default) number of threads\n"
+            << "  -cache       (optional) keep the word vectors in <model>.wv\n"
             << std::endl;
 }
 
@@ -125,8 +156,47 @@ void printDumpUsage() {
             << "  <option>     option from args,dict,input,output" << std::endl;
 }
 
-void test(const std::vector<std::string>& args) {
+void printConvertUsage() {
+  std::cerr << "usage: fasttext convert <model> <output>\n\n"
+            << "  <model>      model filename (.bin or .ftz)\n"
+            << "  <output>     aligned model filename\n"
+            << std::endl;
+}
+
+void printCheckSimdUsage() {
+  std::cerr << "usage: fasttext check-simd\n\n"
+            << "  Checks the kernels of every instruction set this cpu supports\n"
+            << "  against the scalar ones and prints the one in use.\n"
+            << std::endl;
+}
+
+// Removes "-thread <n>" from args and returns n (1 if absent).
+int32_t extractThreadOption(std::vector<std::string>& args) {
+  int32_t nthreads = 1;
+  for (size_t i = 2; i + 1 < args.size(); i++) {
+    if (args[i] == "-thread") {
+      nthreads = std::stoi(args[i + 1]);
+      args.erase(args.begin() + i, args.begin() + i + 2);
+      break;
+    }
+  }
+  return nthreads;
+}
+
+// Removes flag from args and returns whether it was there.
+bool extractFlag(std::vector<std::string>& args, const std::string& flag) {
+  for (size_t i = 2; i < args.size(); i++) {
+    if (args[i] == flag) {
+      args.erase(args.begin() + i);
+      return true;
+    }
+  }
+  return false;
+}
+
+void test(std::vector<std::string> args) {
   bool perLabel = args[1] == "test-label";
+  int32_t nthreads = extractThreadOption(args);
 
   if (args.size() < 4 || args.size() > 6) {
     perLabel ? printTestLabelUsage() : printTestUsage();
@@ -144,14 +214,14 @@ void test(const std::vector<std::string>& args) {
   Meter meter;
 
   if (input == "-") {
-    fasttext.test(std::cin, k, threshold, meter);
+    fasttext.test(std::cin, k, threshold, meter, nthreads);
   } else {
     std::ifstream ifs(input);
     if (!ifs.is_open()) {
       std::cerr << "Test file cannot be opened!" << std::endl;
       exit(EXIT_FAILURE);
     }
-    fasttext.test(ifs, k, threshold, meter);
+    fasttext.test(ifs, k, threshold, meter, nthreads);
   }
 
   if (perLabel) {
@@ -202,7 +272,8 @@ void printPredictions(
   }
 }
 
-void predict(const std::vector<std::string>& args) {
+void predict(std::vector<std::string> args) {
+  int32_t nthreads = extractThreadOption(args);
   if (args.size() < 4 || args.size() > 6) {
     printPredictUsage();
     exit(EXIT_FAILURE);
@@ -232,9 +303,29 @@ void predict(const std::vector<std::string>& args) {
   }
   std::istream& in = inputIsStdIn ? std::cin : ifs;
   std::vector<std::pair<real, std::string>> predictions;
-  while (fasttext.predictLine(in, predictions, k, threshold)) {
-    printPredictions(predictions, printProb, false);
+  if (inputIsStdIn) {
+    // Answers every line as soon as it is read, so that fasttext can be
+    // used interactively or as a coprocess, instead of waiting for whole
+    // chunks of lines.
+    InferenceContext context(fasttext);
+    while (fasttext.predictLine(in, predictions, k, threshold, context)) {
+      printPredictions(predictions, printProb, false);
+    }
+    exit(0);
   }
+  std::shared_ptr<const Dictionary> dict = fasttext.getDictionary();
+  fasttext.predictLines(
+      in,
+      k,
+      threshold,
+      nthreads,
+      [&](const std::vector<int32_t>&, const Predictions& linePredictions) {
+        predictions.clear();
+        for (const auto& p : linePredictions) {
+          predictions.emplace_back(std::exp(p.first), dict->getLabel(p.second));
+        }
+        printPredictions(predictions, printProb, false);
+      });
   if (ifs.is_open()) {
     ifs.close();
   }
@@ -293,18 +384,30 @@ void printNgrams(const std::vector<std::string> args) {
   exit(0);
 }
 
-void nn(const std::vector<std::string> args) {
-  int32_t k;
+void nn(std::vector<std::string> args) {
+  int32_t nthreads = extractThreadOption(args);
+  bool cache = extractFlag(args, "-cache");
+  int32_t k, ef = 0;
   if (args.size() == 3) {
     k = 10;
-  } else if (args.size() == 4) {
+  } else if (args.size() == 4 || args.size() == 5) {
     k = std::stoi(args[3]);
+    if (args.size() == 5) {
+      ef = std::stoi(args[4]);
+    }
   } else {
     printNNUsage();
     exit(EXIT_FAILURE);
   }
   FastText fasttext;
   fasttext.loadModel(std::string(args[2]));
+  fasttext.setNNThreads(nthreads);
+  if (cache) {
+    fasttext.setWordVectorsCache(args[2] + ".wv");
+  }
+  if (ef > 0) {
+    fasttext.setNNIndex(ef, args[2] + ".hnsw");
+  }
   std::string prompt("Query word? ");
   std::cout << prompt;
 
@@ -316,12 +419,60 @@ void nn(const std::vector<std::string> args) {
   exit(0);
 }
 
-void analogies(const std::vector<std::string> args) {
-  int32_t k;
+void nnBatch(std::vector<std::string> args) {
+  const int32_t batchSize = 4096;
+  int32_t nthreads = extractThreadOption(args);
+  bool cache = extractFlag(args, "-cache");
+  if (args.size() < 4 || args.size() > 5) {
+    printNNBatchUsage();
+    exit(EXIT_FAILURE);
+  }
+  int32_t k = args.size() > 4 ? std::stoi(args[4]) : 10;
+  FastText fasttext;
+  fasttext.loadModel(std::string(args[2]));
+  fasttext.setNNThreads(nthreads);
+  if (cache) {
+    fasttext.setWordVectorsCache(args[2] + ".wv");
+  }
+
+  std::ifstream ifs;
+  std::string infile(args[3]);
+  bool inputIsStdIn = infile == "-";
+  if (!inputIsStdIn) {
+    ifs.open(infile);
+    if (!ifs.is_open()) {
+      std::cerr << "Input file cannot be opened!" << std::endl;
+      exit(EXIT_FAILURE);
+    }
+  }
+  std::istream& in = inputIsStdIn ? std::cin : ifs;
+  std::vector<std::string> words;
+  std::string word;
+  while (in) {
+    words.clear();
+    while (words.size() < batchSize && in >> word) {
+      words.push_back(word);
+    }
+    auto results = fasttext.getNNBatch(words, k);
+    for (size_t i = 0; i < words.size(); i++) {
+      std::cout << words[i] << " ";
+      printPredictions(results[i], true, false);
+    }
+  }
+  exit(0);
+}
+
+void analogies(std::vector<std::string> args) {
+  int32_t nthreads = extractThreadOption(args);
+  bool cache = extractFlag(args, "-cache");
+  int32_t k, ef = 0;
   if (args.size() == 3) {
     k = 10;
-  } else if (args.size() == 4) {
+  } else if (args.size() == 4 || args.size() == 5) {
     k = std::stoi(args[3]);
+    if (args.size() == 5) {
+      ef = std::stoi(args[4]);
+    }
   } else {
     printAnalogiesUsage();
     exit(EXIT_FAILURE);
@@ -333,6 +484,13 @@ void analogies(const std::vector<std::string> args) {
   std::string model(args[2]);
   std::cout << "Loading model " << model << std::endl;
   fasttext.loadModel(model);
+  fasttext.setNNThreads(nthreads);
+  if (cache) {
+    fasttext.setWordVectorsCache(args[2] + ".wv");
+  }
+  if (ef > 0) {
+    fasttext.setNNIndex(ef, model + ".hnsw");
+  }
 
   std::string prompt("Query triplet (A - B + C)? ");
   std::string wordA, wordB, wordC;
@@ -400,6 +558,31 @@ void dump(const std::vector<std::string>& args) {
   }
 }
 
+void convert(const std::vector<std::string>& args) {
+  if (args.size() != 4) {
+    printConvertUsage();
+    exit(EXIT_FAILURE);
+  }
+  FastText fasttext;
+  fasttext.loadModel(args[2]);
+  fasttext.saveModel(args[3], true);
+  exit(0);
+}
+
+void checkSimd(const std::vector<std::string>& args) {
+  if (args.size() != 2) {
+    printCheckSimdUsage();
+    exit(EXIT_FAILURE);
+  }
+  if (!simd::selfTest()) {
+    std::cerr << "The vector kernels differ from the scalar ones!"
+              << std::endl;
+    exit(EXIT_FAILURE);
+  }
+  std::cout << simd::active().name << std::endl;
+  exit(0);
+}
+
 int main(int argc, char** argv) {
   std::vector<std::string> args(argv, argv + argc);
   if (args.size() < 2) {
@@ -421,12 +604,18 @@ int main(int argc, char** argv) {
     printNgrams(args);
   } else if (command == "nn") {
     nn(args);
+  } else if (command == "nn-batch") {
+    nnBatch(args);
   } else if (command == "analogies") {
     analogies(args);
   } else if (command == "predict" || command == "predict-prob") {
     predict(args);
   } else if (command == "dump") {
     dump(args);
+  } else if (command == "convert") {
+    convert(args);
+  } else if (command == "check-simd") {
+    checkSimd(args);
   } else {
     printUsage();
     exit(EXIT_FAILURE);
@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "mappedmatrix.h"
+
+#include <assert.h>
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+#include "densematrix.h"
+#include "simd.h"
+#include "vector.h"
+
+namespace fasttext {
+
+MappedMatrix::MappedMatrix(std::shared_ptr<const MemoryMap> map)
+    : Matrix(), map_(map), data_(nullptr) {}
+
+real MappedMatrix::dotRow(const Vector& vec, int64_t i) const {
+  assert(i >= 0);
+  assert(i < m_);
+  assert(vec.size() == n_);
+  real d = simd::dot(data_ + i * n_, vec.data(), n_);
+  if (std::isnan(d)) {
+    throw std::runtime_error("Encountered NaN.");
+  }
+  return d;
+}
+
+void MappedMatrix::gemv(const Vector& x, Vector& y) const {
+  assert(x.size() == n_);
+  assert(y.size() == m_);
+  simd::gemv(data_, m_, n_, x.data(), y.data());
+  checkNaN(y.data(), m_);
+}
+
+void MappedMatrix::gemm(const DenseMatrix& x, DenseMatrix& y) const {
+  assert(x.size(1) == n_);
+  assert(y.size(0) == x.size(0));
+  assert(y.size(1) == m_);
+  simd::gemm(data_, m_, n_, x.data(), x.size(0), y.data());
+  checkNaN(y.data(), y.size(0) * m_);
+}
+
+void MappedMatrix::addVectorToRow(const Vector&, int64_t, real) {
+  throw std::runtime_error(
+      "Operation not permitted on memory-mapped matrices.");
+}
+
+void MappedMatrix::addRowToVector(Vector& x, int32_t i) const {
+  assert(i >= 0);
+  assert(i < m_);
+  assert(x.size() == n_);
+  simd::add(data_ + i * n_, x.data(), n_);
+}
+
+void MappedMatrix::addRowToVector(Vector& x, int32_t i, real a) const {
+  assert(i >= 0);
+  assert(i < m_);
+  assert(x.size() == n_);
+  simd::axpy(a, data_ + i * n_, x.data(), n_);
+}
+
+void MappedMatrix::save(std::ostream& out) const {
+  out.write((char*)&m_, sizeof(int64_t));
+  out.write((char*)&n_, sizeof(int64_t));
+  out.write((char*)data_, m_ * n_ * sizeof(real));
+}
+
+void MappedMatrix::load(std::istream& in) {
+  in.read((char*)&m_, sizeof(int64_t));
+  in.read((char*)&n_, sizeof(int64_t));
+  int64_t offset = in.tellg();
+  int64_t bytes = m_ * n_ * sizeof(real);
+  if (!in || offset < 0 || offset + bytes > map_->size()) {
+    throw std::invalid_argument("Invalid model file.");
+  }
+  const char* begin = map_->data() + offset;
+  if (reinterpret_cast<uintptr_t>(begin) % alignof(real) == 0) {
+    data_ = reinterpret_cast<const real*>(begin);
+  } else {
+    fallback_ = std::vector<real>(m_ * n_);
+    std::memcpy(fallback_.data(), begin, bytes);
+    data_ = fallback_.data();
+  }
+  in.seekg(offset + bytes);
+}
+
+void MappedMatrix::dump(std::ostream& out) const {
+  out << m_ << " " << n_ << std::endl;
+  for (int64_t i = 0; i < m_; i++) {
+    for (int64_t j = 0; j < n_; j++) {
+      if (j > 0) {
+        out << " ";
+      }
+      out << at(i, j);
+    }
+    out << std::endl;
+  }
+}
+
+} // namespace fasttext
@@ -0,0 +1,64 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <vector>
+
+#include "matrix.h"
+#include "memorymap.h"
+#include "real.h"
+
+namespace fasttext {
+
+class Vector;
+
+// Read-only dense matrix whose rows live directly in a memory-mapped model
+// file. load() reads the header through a stream over the same mapping and
+// points data_ at the bytes that follow it instead of copying them.
+class MappedMatrix : public Matrix {
+ protected:
+  std::shared_ptr<const MemoryMap> map_;
+  const real* data_;
+  // Only used when the rows are not suitably aligned inside the file.
+  std::vector<real> fallback_;
+
+ public:
+  explicit MappedMatrix(std::shared_ptr<const MemoryMap> map);
+  MappedMatrix(const MappedMatrix&) = delete;
+  MappedMatrix(MappedMatrix&&) = delete;
+  MappedMatrix& operator=(const MappedMatrix&) = delete;
+  MappedMatrix& operator=(MappedMatrix&&) = delete;
+  virtual ~MappedMatrix() noexcept override final = default;
+
+  inline const real* data() const {
+    return data_;
+  }
+  inline const real& at(int64_t i, int64_t j) const {
+    return data_[i * n_ + j];
+  }
+  inline bool isMapped() const {
+    return fallback_.empty();
+  }
+
+  real dotRow(const Vector&, int64_t) const override;
+  void gemv(const Vector& x, Vector& y) const override;
+  void gemm(const DenseMatrix& x, DenseMatrix& y) const override;
+  void addVectorToRow(const Vector&, int64_t, real) override;
+  void addRowToVector(Vector& x, int32_t i) const override;
+  void addRowToVector(Vector& x, int32_t i, real a) const override;
+  void save(std::ostream&) const override;
+  void load(std::istream&) override;
+  void dump(std::ostream&) const override;
+};
+
+} // namespace fasttext
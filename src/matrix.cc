@@ -8,12 +8,27 @@
 
 #include "matrix.h"
 
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+#include "densematrix.h"
+#include "vector.h"
+
 namespace fasttext {
 
 Matrix::Matrix() : m_(0), n_(0) {}
 
 Matrix::Matrix(int64_t m, int64_t n) : m_(m), n_(n) {}
 
+void Matrix::checkNaN(const real* x, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    if (std::isnan(x[i])) {
+      throw std::runtime_error("Encountered NaN.");
+    }
+  }
+}
+
 int64_t Matrix::size(int64_t dim) const {
   assert(dim == 0 || dim == 1);
   if (dim == 0) {
@@ -22,4 +37,46 @@ int64_t Matrix::size(int64_t dim) const {
   return n_;
 }
 
+void Matrix::gemv(const Vector& x, Vector& y) const {
+  assert(x.size() == n_);
+  assert(y.size() == m_);
+  for (int64_t i = 0; i < m_; i++) {
+    y[i] = dotRow(x, i);
+  }
+}
+
+void Matrix::dotRows(
+    const Vector& x,
+    const int32_t* rows,
+    int64_t m,
+    real* out) const {
+  for (int64_t j = 0; j < m; j++) {
+    out[j] = dotRow(x, rows[j]);
+  }
+}
+
+void Matrix::updateRows(
+    const Vector& x,
+    const int32_t* rows,
+    const real* alpha,
+    int64_t m,
+    Vector& y) {
+  for (int64_t j = 0; j < m; j++) {
+    addRowToVector(y, rows[j], alpha[j]);
+    addVectorToRow(x, rows[j], alpha[j]);
+  }
+}
+
+void Matrix::gemm(const DenseMatrix& x, DenseMatrix& y) const {
+  assert(x.size(1) == n_);
+  assert(y.size(0) == x.size(0));
+  assert(y.size(1) == m_);
+  Vector xrow(n_), yrow(m_);
+  for (int64_t b = 0; b < x.size(0); b++) {
+    std::copy(x.data() + b * n_, x.data() + (b + 1) * n_, xrow.data());
+    gemv(xrow, yrow);
+    std::copy(yrow.data(), yrow.data() + m_, y.data() + b * m_);
+  }
+}
+
 } // namespace fasttext
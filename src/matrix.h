@@ -18,6 +18,7 @@
 
 namespace fasttext {
 
+class DenseMatrix;
 class Vector;
 
 class Matrix {
@@ -25,6 +26,9 @@ class Matrix {
   int64_t m_;
   int64_t n_;
 
+  // Throws when one of the n values is NaN.
+  static void checkNaN(const real* x, int64_t n);
+
  public:
   Matrix();
   explicit Matrix(int64_t, int64_t);
@@ -33,7 +37,22 @@ class Matrix {
   int64_t size(int64_t dim) const;
 
   virtual real dotRow(const Vector&, int64_t) const = 0;
+  // y = A x. Computes the same values as calling dotRow for every row.
+  virtual void gemv(const Vector& x, Vector& y) const;
+  // y = x A^T, i.e. gemv for every row of x.
+  virtual void gemm(const DenseMatrix& x, DenseMatrix& y) const;
+  // out[j] = dotRow(x, rows[j]) for j < m.
+  virtual void
+  dotRows(const Vector& x, const int32_t* rows, int64_t m, real* out) const;
   virtual void addVectorToRow(const Vector&, int64_t, real) = 0;
+  // For j < m in order: addRowToVector(y, rows[j], alpha[j]), then
+  // addVectorToRow(x, rows[j], alpha[j]).
+  virtual void updateRows(
+      const Vector& x,
+      const int32_t* rows,
+      const real* alpha,
+      int64_t m,
+      Vector& y);
   virtual void addRowToVector(Vector& x, int32_t i) const = 0;
   virtual void addRowToVector(Vector& x, int32_t i, real a) const = 0;
   virtual void save(std::ostream&) const = 0;
@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "memorymap.h"
+
+#include <stdexcept>
+
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fasttext {
+
+#if !defined(_WIN32)
+
+MemoryMap::MemoryMap(const std::string& filename)
+    : data_(nullptr), size_(0) {
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw std::invalid_argument(filename + " cannot be opened for mapping!");
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    throw std::invalid_argument(filename + " cannot be mapped!");
+  }
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    throw std::invalid_argument(filename + " cannot be mapped!");
+  }
+  data_ = static_cast<const char*>(addr);
+  size_ = st.st_size;
+}
+
+MemoryMap::~MemoryMap() {
+  if (data_) {
+    munmap(const_cast<char*>(data_), size_);
+  }
+}
+
+#else
+
+MemoryMap::MemoryMap(const std::string&) : data_(nullptr), size_(0) {
+  throw std::runtime_error("Memory mapping is not supported on this platform.");
+}
+
+MemoryMap::~MemoryMap() {}
+
+#endif
+
+MemoryMapBuffer::MemoryMapBuffer(const MemoryMap& map) {
+  char* begin = const_cast<char*>(map.data());
+  setg(begin, begin, begin + map.size());
+}
+
+MemoryMapBuffer::pos_type MemoryMapBuffer::seekoff(
+    off_type off,
+    std::ios_base::seekdir dir,
+    std::ios_base::openmode which) {
+  if (!(which & std::ios_base::in)) {
+    return pos_type(off_type(-1));
+  }
+  char* target;
+  if (dir == std::ios_base::beg) {
+    target = eback() + off;
+  } else if (dir == std::ios_base::cur) {
+    target = gptr() + off;
+  } else {
+    target = egptr() + off;
+  }
+  if (target < eback() || target > egptr()) {
+    return pos_type(off_type(-1));
+  }
+  setg(eback(), target, egptr());
+  return pos_type(target - eback());
+}
+
+MemoryMapBuffer::pos_type MemoryMapBuffer::seekpos(
+    pos_type pos,
+    std::ios_base::openmode which) {
+  return seekoff(off_type(pos), std::ios_base::beg, which);
+}
+
+} // namespace fasttext
@@ -0,0 +1,54 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <streambuf>
+#include <string>
+
+namespace fasttext {
+
+// Read-only mapping of a whole file. Pages are shared with the page cache,
+// so every process mapping the same model uses a single physical copy.
+class MemoryMap {
+ protected:
+  const char* data_;
+  int64_t size_;
+
+ public:
+  explicit MemoryMap(const std::string& filename);
+  MemoryMap(const MemoryMap&) = delete;
+  MemoryMap& operator=(const MemoryMap&) = delete;
+  ~MemoryMap();
+
+  inline const char* data() const {
+    return data_;
+  }
+  inline int64_t size() const {
+    return size_;
+  }
+};
+
+// Seekable std::streambuf over the bytes of a MemoryMap, so the regular
+// load(std::istream&) code paths can parse headers straight from the mapping
+// and report the offsets of the data that follows them.
+class MemoryMapBuffer : public std::streambuf {
+ public:
+  explicit MemoryMapBuffer(const MemoryMap& map);
+
+ protected:
+  pos_type seekoff(
+      off_type off,
+      std::ios_base::seekdir dir,
+      std::ios_base::openmode which) override;
+  pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+};
+
+} // namespace fasttext
@@ -42,12 +42,17 @@ Model::Model(
 
 void Model::computeHidden(const std::vector<int32_t>& input, State& state)
     const {
+  computeHidden(input.data(), input.size(), state);
+}
+
+void Model::computeHidden(const int32_t* input, int64_t n, State& state)
+    const {
   Vector& hidden = state.hidden;
   hidden.zero();
-  for (auto it = input.cbegin(); it != input.cend(); ++it) {
-    hidden.addRow(*wi_, *it);
+  for (int64_t i = 0; i < n; i++) {
+    hidden.addRow(*wi_, input[i]);
   }
-  hidden.mul(1.0 / input.size());
+  hidden.mul(1.0 / n);
 }
 
 void Model::predict(
@@ -72,16 +77,68 @@ void Model::predict(const std::vector<int32_t>& input, Predictions& predictions,
   loss_->predict(predictions, state);
 }
 
+void Model::predict(
+    const std::vector<std::vector<int32_t>>& inputs,
+    int32_t k,
+    real threshold,
+    std::vector<Predictions>& heaps,
+    State& state) const {
+  if (k == Model::kUnlimitedPredictions) {
+    k = wo_->size(0); // output size
+  } else if (k <= 0) {
+    throw std::invalid_argument("k needs to be 1 or higher!");
+  }
+  heaps.resize(inputs.size());
+  std::vector<int64_t> rows;
+  for (size_t b = 0; b < inputs.size(); b++) {
+    heaps[b].clear();
+    if (!inputs[b].empty()) {
+      rows.push_back(b);
+    }
+  }
+  if (rows.empty()) {
+    return;
+  }
+
+  const int64_t dim = wi_->size(1);
+  DenseMatrix& hidden = state.batchHidden;
+  hidden.resize(rows.size(), dim);
+  for (size_t j = 0; j < rows.size(); j++) {
+    computeHidden(inputs[rows[j]], state);
+    std::copy(
+        state.hidden.data(), state.hidden.data() + dim, hidden.data() + j * dim);
+  }
+  std::vector<Predictions> rowHeaps(rows.size());
+  for (size_t j = 0; j < rows.size(); j++) {
+    rowHeaps[j].swap(heaps[rows[j]]);
+    rowHeaps[j].reserve(k + 1);
+  }
+  loss_->predict(k, threshold, hidden, rowHeaps, state);
+  for (size_t j = 0; j < rows.size(); j++) {
+    heaps[rows[j]].swap(rowHeaps[j]);
+  }
+}
+
 void Model::update(
     const std::vector<int32_t>& input,
     const std::vector<int32_t>& targets,
     int32_t targetIndex,
     real lr,
     State& state) {
-  if (input.size() == 0) {
+  update(input.data(), input.size(), targets, targetIndex, lr, state);
+}
+
+void Model::update(
+    const int32_t* input,
+    int64_t n,
+    const std::vector<int32_t>& targets,
+    int32_t targetIndex,
+    real lr,
+    State& state) {
+  if (n == 0) {
     return;
   }
-  computeHidden(input, state);
+  computeHidden(input, n, state);
 
   Vector& grad = state.grad;
   grad.zero();
@@ -89,10 +146,10 @@ void Model::update(
   state.incrementNExamples(lossValue);
 
   if (normalizeGradient_) {
-    grad.mul(1.0 / input.size());
+    grad.mul(1.0 / n);
   }
-  for (auto it = input.cbegin(); it != input.cend(); ++it) {
-    wi_->addVectorToRow(grad, *it, 1.0);
+  for (int64_t i = 0; i < n; i++) {
+    wi_->addVectorToRow(grad, input[i], 1.0);
   }
 }
 
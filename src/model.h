@@ -13,8 +13,10 @@
 #include <utility>
 #include <vector>
 
+#include "densematrix.h"
 #include "matrix.h"
 #include "real.h"
+#include "topk.h"
 #include "utils.h"
 #include "vector.h"
 
@@ -50,6 +52,16 @@ class Model {
     Vector output;
     Vector grad;
     std::minstd_rand rng;
+    TopK topk;
+    // Work list of tree searches, such as hierarchical softmax prediction.
+    Predictions frontier;
+    // Output rows of a negative sampling step and their scores.
+    std::vector<int32_t> samples;
+    std::vector<real> scores;
+    // Hidden vectors and output scores of a batch of inputs, kept between
+    // batches.
+    DenseMatrix batchHidden;
+    DenseMatrix batchScores;
 
     State(int32_t hiddenSize, int32_t outputSize, int32_t seed);
     real getLoss() const;
@@ -65,13 +77,33 @@ class Model {
 
   void predict(const std::vector<int32_t>& input, Predictions& predictions, State& state) const;
 
+  // Predicts for a batch of inputs with one matrix-matrix product against
+  // the output layer. heaps gets one entry per input; empty inputs get no
+  // predictions.
+  void predict(
+      const std::vector<std::vector<int32_t>>& inputs,
+      int32_t k,
+      real threshold,
+      std::vector<Predictions>& heaps,
+      State& state) const;
+
   void update(
       const std::vector<int32_t>& input,
       const std::vector<int32_t>& targets,
       int32_t targetIndex,
       real lr,
       State& state);
+  // Same as above, with the input given as n ids starting at input, such
+  // as the subwords of a dictionary entry.
+  void update(
+      const int32_t* input,
+      int64_t n,
+      const std::vector<int32_t>& targets,
+      int32_t targetIndex,
+      real lr,
+      State& state);
   void computeHidden(const std::vector<int32_t>& input, State& state) const;
+  void computeHidden(const int32_t* input, int64_t n, State& state) const;
 
   real std_log(real) const;
 
@@ -14,13 +14,19 @@
 
 namespace fasttext {
 
-QuantMatrix::QuantMatrix() : Matrix(), qnorm_(false), codesize_(0) {}
+QuantMatrix::QuantMatrix()
+    : Matrix(), codesData_(nullptr), qnorm_(false), codesize_(0) {}
+
+QuantMatrix::QuantMatrix(std::shared_ptr<const MemoryMap> map)
+    : Matrix(), codesData_(nullptr), map_(map), qnorm_(false), codesize_(0) {}
 
 QuantMatrix::QuantMatrix(DenseMatrix&& mat, int32_t dsub, bool qnorm)
     : Matrix(mat.size(0), mat.size(1)),
+      codesData_(nullptr),
       qnorm_(qnorm),
       codesize_(mat.size(0) * ((mat.size(1) + dsub - 1) / dsub)) {
   codes_.resize(codesize_);
+  codesData_ = codes_.data();
   pq_ = std::unique_ptr<ProductQuantizer>(new ProductQuantizer(n_, dsub));
   if (qnorm_) {
     norm_codes_.resize(m_);
@@ -57,7 +63,7 @@ real QuantMatrix::dotRow(const Vector& vec, int64_t i) const {
   if (qnorm_) {
     norm = npq_->get_centroids(0, norm_codes_[i])[0];
   }
-  return pq_->mulcode(vec, codes_.data(), i, norm);
+  return pq_->mulcode(vec, codesData_, i, norm);
 }
 
 void QuantMatrix::addVectorToRow(const Vector&, int64_t, real) {
@@ -69,7 +75,7 @@ void QuantMatrix::addRowToVector(Vector& x, int32_t i, real a) const {
   if (qnorm_) {
     norm = npq_->get_centroids(0, norm_codes_[i])[0];
   }
-  pq_->addcode(x, codes_.data(), i, a * norm);
+  pq_->addcode(x, codesData_, i, a * norm);
 }
 
 void QuantMatrix::addRowToVector(Vector& x, int32_t i) const {
@@ -77,7 +83,7 @@ void QuantMatrix::addRowToVector(Vector& x, int32_t i) const {
   if (qnorm_) {
     norm = npq_->get_centroids(0, norm_codes_[i])[0];
   }
-  pq_->addcode(x, codes_.data(), i, norm);
+  pq_->addcode(x, codesData_, i, norm);
 }
 
 void QuantMatrix::save(std::ostream& out) const {
@@ -85,7 +91,7 @@ void QuantMatrix::save(std::ostream& out) const {
   out.write((char*)&m_, sizeof(m_));
   out.write((char*)&n_, sizeof(n_));
   out.write((char*)&codesize_, sizeof(codesize_));
-  out.write((char*)codes_.data(), codesize_ * sizeof(uint8_t));
+  out.write((char*)codesData_, codesize_ * sizeof(uint8_t));
   pq_->save(out);
   if (qnorm_) {
     out.write((char*)norm_codes_.data(), m_ * sizeof(uint8_t));
@@ -98,8 +104,19 @@ void QuantMatrix::load(std::istream& in) {
   in.read((char*)&m_, sizeof(m_));
   in.read((char*)&n_, sizeof(n_));
   in.read((char*)&codesize_, sizeof(codesize_));
-  codes_ = std::vector<uint8_t>(codesize_);
-  in.read((char*)codes_.data(), codesize_ * sizeof(uint8_t));
+  if (map_) {
+    int64_t offset = in.tellg();
+    if (!in || offset < 0 || offset + codesize_ > map_->size()) {
+      throw std::invalid_argument("Invalid model file.");
+    }
+    codes_.clear();
+    codesData_ = reinterpret_cast<const uint8_t*>(map_->data() + offset);
+    in.seekg(offset + codesize_);
+  } else {
+    codes_ = std::vector<uint8_t>(codesize_);
+    in.read((char*)codes_.data(), codesize_ * sizeof(uint8_t));
+    codesData_ = codes_.data();
+  }
   pq_ = std::unique_ptr<ProductQuantizer>(new ProductQuantizer());
   pq_->load(in);
   if (qnorm_) {
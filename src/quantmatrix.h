@@ -19,6 +19,7 @@
 
 #include "densematrix.h"
 #include "matrix.h"
+#include "memorymap.h"
 #include "vector.h"
 
 #include "productquantizer.h"
@@ -33,11 +34,16 @@ class QuantMatrix : public Matrix {
   std::vector<uint8_t> codes_;
   std::vector<uint8_t> norm_codes_;
 
+  // Points either into codes_ or, for mapped models, into map_.
+  const uint8_t* codesData_;
+  std::shared_ptr<const MemoryMap> map_;
+
   bool qnorm_;
   int32_t codesize_;
 
  public:
   QuantMatrix();
+  explicit QuantMatrix(std::shared_ptr<const MemoryMap> map);
   QuantMatrix(DenseMatrix&&, int32_t, bool);
   QuantMatrix(const QuantMatrix&) = delete;
   QuantMatrix(QuantMatrix&&) = delete;
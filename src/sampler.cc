@@ -0,0 +1,126 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "sampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace fasttext {
+
+namespace {
+
+// Number of values drawn by the generator of Model::State.
+constexpr uint64_t RNG_RANGE =
+    uint64_t(std::minstd_rand::max()) - std::minstd_rand::min() + 1;
+
+} // namespace
+
+Sampler::Sampler(sampler_name name, const std::vector<int64_t>& counts)
+    : name_(name), counts_(counts) {}
+
+void Sampler::build() {
+  std::call_once(buildOnce_, [this]() {
+    if (name_ == sampler_name::table) {
+      buildTable();
+    } else if (name_ == sampler_name::alias) {
+      buildAliases();
+    }
+  });
+}
+
+void Sampler::buildTable() {
+  real z = 0.0;
+  for (size_t i = 0; i < counts_.size(); i++) {
+    z += pow(counts_[i], 0.5);
+  }
+  probabilities_.resize(counts_.size());
+  for (size_t i = 0; i < counts_.size(); i++) {
+    real c = pow(counts_[i], 0.5);
+    const size_t begin = negatives_.size();
+    for (size_t j = 0; j < c * Sampler::NEGATIVE_TABLE_SIZE / z; j++) {
+      negatives_.push_back(i);
+    }
+    probabilities_[i] = negatives_.size() - begin;
+  }
+  for (size_t i = 0; i < counts_.size(); i++) {
+    probabilities_[i] /= negatives_.size();
+  }
+}
+
+// Walker's alias method, built with Vose's work lists: every column holds
+// at most two targets, so a sample is one uniform column and one coin.
+void Sampler::buildAliases() {
+  const int32_t n = counts_.size();
+  const double range = RNG_RANGE;
+  std::vector<double> mass(n);
+  double z = 0.0;
+  for (int32_t i = 0; i < n; i++) {
+    mass[i] = std::sqrt(double(counts_[i]));
+    z += mass[i];
+  }
+  probabilities_.resize(n);
+  std::vector<int32_t> small, large;
+  for (int32_t i = 0; i < n; i++) {
+    probabilities_[i] = mass[i] / z;
+    mass[i] *= n / z;
+    if (mass[i] < 1.0) {
+      small.push_back(i);
+    } else {
+      large.push_back(i);
+    }
+  }
+  aliases_.resize(n);
+  while (!small.empty() && !large.empty()) {
+    int32_t s = small.back();
+    int32_t l = large.back();
+    small.pop_back();
+    aliases_[s].threshold = uint32_t(mass[s] * range);
+    aliases_[s].alias = l;
+    mass[l] -= 1.0 - mass[s];
+    if (mass[l] < 1.0) {
+      large.pop_back();
+      small.push_back(l);
+    }
+  }
+  // what is left has mass 1 up to rounding
+  for (int32_t i : small) {
+    aliases_[i].threshold = uint32_t(range);
+    aliases_[i].alias = i;
+  }
+  for (int32_t i : large) {
+    aliases_[i].threshold = uint32_t(range);
+    aliases_[i].alias = i;
+  }
+}
+
+int32_t Sampler::sample(std::minstd_rand& rng) const {
+  if (name_ == sampler_name::alias) {
+    const uint64_t n = aliases_.size();
+    const uint64_t column = (rng() - std::minstd_rand::min()) * n / RNG_RANGE;
+    const AliasEntry& entry = aliases_[column];
+    return rng() - std::minstd_rand::min() < entry.threshold ? int32_t(column)
+                                                             : entry.alias;
+  } else if (name_ == sampler_name::loguniform) {
+    const double n = counts_.size();
+    const double u = double(rng() - std::minstd_rand::min()) / RNG_RANGE;
+    const int64_t i = int64_t(std::exp(u * std::log(n + 1))) - 1;
+    return std::min(i, int64_t(n - 1));
+  }
+  std::uniform_int_distribution<size_t> uniform(0, negatives_.size() - 1);
+  return negatives_[uniform(rng)];
+}
+
+real Sampler::probability(int32_t i) const {
+  if (name_ == sampler_name::loguniform) {
+    return std::log((i + 2.0) / (i + 1.0)) / std::log(counts_.size() + 1.0);
+  }
+  return probabilities_[i];
+}
+
+} // namespace fasttext
@@ -0,0 +1,58 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <vector>
+
+#include "args.h"
+#include "real.h"
+
+namespace fasttext {
+
+// Draws targets from a fixed distribution over [0, n), for negative
+// sampling and sampled softmax. table and alias draw target i with
+// probability proportional to sqrt(counts[i]). loguniform relies on the
+// targets being sorted by decreasing count, as in the dictionary, and
+// draws i with probability log((i + 2) / (i + 1)) / log(n + 1).
+class Sampler {
+ protected:
+  static const int32_t NEGATIVE_TABLE_SIZE = 10000000;
+
+  // Column of the alias table: the column's own target is drawn when a
+  // uniform draw of the generator is below threshold, alias otherwise.
+  struct AliasEntry {
+    uint32_t threshold;
+    int32_t alias;
+  };
+
+  sampler_name name_;
+  std::vector<int64_t> counts_;
+  std::once_flag buildOnce_;
+  std::vector<int32_t> negatives_;
+  std::vector<AliasEntry> aliases_;
+  std::vector<real> probabilities_;
+
+  void buildTable();
+  void buildAliases();
+
+ public:
+  Sampler(sampler_name name, const std::vector<int64_t>& counts);
+
+  // Builds the tables at the first call. Samplers are only needed to
+  // train, so this is not done at model load.
+  void build();
+  int32_t sample(std::minstd_rand& rng) const;
+  // Probability that sample returns i.
+  real probability(int32_t i) const;
+};
+
+} // namespace fasttext
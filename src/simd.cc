@@ -0,0 +1,842 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "simd.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FASTTEXT_SIMD_X86
+#include <immintrin.h>
+#endif
+
+namespace fasttext {
+
+namespace simd {
+
+static_assert(
+    std::is_same<real, float>::value,
+    "The vector kernels are written for single precision.");
+
+namespace {
+
+const int GEMV_ROWS = 4;
+const int64_t GEMM_BLOCK_BYTES = 128 * 1024;
+
+real dotScalar(const real* x, const real* y, int64_t n) {
+  real d = 0.0;
+  for (int64_t i = 0; i < n; i++) {
+    d += x[i] * y[i];
+  }
+  return d;
+}
+
+void axpyScalar(real a, const real* x, real* y, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    y[i] += a * x[i];
+  }
+}
+
+void addScalar(const real* x, real* y, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    y[i] += x[i];
+  }
+}
+
+void scaleScalar(real a, real* x, int64_t n) {
+  for (int64_t i = 0; i < n; i++) {
+    x[i] *= a;
+  }
+}
+
+void gemvScalar(
+    const real* a,
+    const int32_t* rows,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    real* y) {
+  for (int64_t r = 0; r < m; r++) {
+    y[r] = dotScalar(a + (rows ? rows[r] : r) * n, x, n);
+  }
+}
+
+void updateRowsScalar(
+    real* a,
+    const int32_t* rows,
+    const real* alpha,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    real* y) {
+  for (int64_t r = 0; r < m; r++) {
+    real* row = a + rows[r] * n;
+    for (int64_t i = 0; i < n; i++) {
+      y[i] += alpha[r] * row[i];
+      row[i] += alpha[r] * x[i];
+    }
+  }
+}
+
+int64_t filterScalar(const real* x, int64_t n, real threshold, int32_t* idx) {
+  int64_t count = 0;
+  for (int64_t i = 0; i < n; i++) {
+    idx[count] = i;
+    count += x[i] >= threshold;
+  }
+  return count;
+}
+
+const Kernels kScalar = {
+    "scalar",
+    dotScalar,
+    axpyScalar,
+    addScalar,
+    scaleScalar,
+    gemvScalar,
+    updateRowsScalar,
+    filterScalar};
+
+#ifdef FASTTEXT_SIMD_X86
+
+__attribute__((target("sse2"))) real dotSse(
+    const real* x,
+    const real* y,
+    int64_t n) {
+  __m128 acc0 = _mm_setzero_ps();
+  __m128 acc1 = _mm_setzero_ps();
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+    acc1 = _mm_add_ps(
+        acc1, _mm_mul_ps(_mm_loadu_ps(x + i + 4), _mm_loadu_ps(y + i + 4)));
+  }
+  if (i + 4 <= n) {
+    acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(x + i), _mm_loadu_ps(y + i)));
+    i += 4;
+  }
+  acc0 = _mm_add_ps(acc0, acc1);
+  acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+  acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+  real d = _mm_cvtss_f32(acc0);
+  for (; i < n; i++) {
+    d += x[i] * y[i];
+  }
+  return d;
+}
+
+__attribute__((target("sse2"))) void axpySse(
+    real a,
+    const real* x,
+    real* y,
+    int64_t n) {
+  const __m128 va = _mm_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(
+        y + i,
+        _mm_add_ps(_mm_loadu_ps(y + i), _mm_mul_ps(va, _mm_loadu_ps(x + i))));
+  }
+  for (; i < n; i++) {
+    y[i] += a * x[i];
+  }
+}
+
+__attribute__((target("sse2"))) void addSse(
+    const real* x,
+    real* y,
+    int64_t n) {
+  int64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(y + i, _mm_add_ps(_mm_loadu_ps(y + i), _mm_loadu_ps(x + i)));
+  }
+  for (; i < n; i++) {
+    y[i] += x[i];
+  }
+}
+
+__attribute__((target("sse2"))) void scaleSse(real a, real* x, int64_t n) {
+  const __m128 va = _mm_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    _mm_storeu_ps(x + i, _mm_mul_ps(va, _mm_loadu_ps(x + i)));
+  }
+  for (; i < n; i++) {
+    x[i] *= a;
+  }
+}
+
+// The gemv kernels compute GEMV_ROWS rows at a time so that every load of
+// x is shared by several rows. Each row is accumulated in exactly the same
+// order as by the dot kernel of the same instruction set, which keeps
+// gemv and dotRow bitwise identical. Rows are consecutive, or picked by
+// index when rows is not null.
+__attribute__((target("sse2"))) void gemvSse(
+    const real* a,
+    const int32_t* rows,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    real* y) {
+  int64_t r = 0;
+  for (; r + GEMV_ROWS <= m; r += GEMV_ROWS) {
+    const real* row[GEMV_ROWS];
+    __m128 acc0[GEMV_ROWS], acc1[GEMV_ROWS];
+    for (int k = 0; k < GEMV_ROWS; k++) {
+      row[k] = a + (rows ? rows[r + k] : r + k) * n;
+      acc0[k] = _mm_setzero_ps();
+      acc1[k] = _mm_setzero_ps();
+    }
+    int64_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+      const __m128 x0 = _mm_loadu_ps(x + i);
+      const __m128 x1 = _mm_loadu_ps(x + i + 4);
+      for (int k = 0; k < GEMV_ROWS; k++) {
+        acc0[k] = _mm_add_ps(acc0[k], _mm_mul_ps(_mm_loadu_ps(row[k] + i), x0));
+        acc1[k] =
+            _mm_add_ps(acc1[k], _mm_mul_ps(_mm_loadu_ps(row[k] + i + 4), x1));
+      }
+    }
+    if (i + 4 <= n) {
+      const __m128 x0 = _mm_loadu_ps(x + i);
+      for (int k = 0; k < GEMV_ROWS; k++) {
+        acc0[k] = _mm_add_ps(acc0[k], _mm_mul_ps(_mm_loadu_ps(row[k] + i), x0));
+      }
+      i += 4;
+    }
+    for (int k = 0; k < GEMV_ROWS; k++) {
+      __m128 s = _mm_add_ps(acc0[k], acc1[k]);
+      s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+      s = _mm_add_ss(s, _mm_shuffle_ps(s, s, 1));
+      real d = _mm_cvtss_f32(s);
+      for (int64_t j = i; j < n; j++) {
+        d += row[k][j] * x[j];
+      }
+      y[r + k] = d;
+    }
+  }
+  for (; r < m; r++) {
+    y[r] = dotSse(a + (rows ? rows[r] : r) * n, x, n);
+  }
+}
+
+// Within a block of the vector, the rows are updated in order, and every
+// row is reloaded after the previous store, so repeated rows are handled
+// as by consecutive axpy calls.
+__attribute__((target("sse2"))) void updateRowsSse(
+    real* a,
+    const int32_t* rows,
+    const real* alpha,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    real* y) {
+  int64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128 vx = _mm_loadu_ps(x + i);
+    __m128 vy = _mm_loadu_ps(y + i);
+    for (int64_t r = 0; r < m; r++) {
+      real* row = a + rows[r] * n + i;
+      const __m128 va = _mm_set1_ps(alpha[r]);
+      const __m128 w = _mm_loadu_ps(row);
+      vy = _mm_add_ps(vy, _mm_mul_ps(va, w));
+      _mm_storeu_ps(row, _mm_add_ps(w, _mm_mul_ps(va, vx)));
+    }
+    _mm_storeu_ps(y + i, vy);
+  }
+  for (int64_t r = 0; r < m; r++) {
+    real* row = a + rows[r] * n;
+    for (int64_t j = i; j < n; j++) {
+      y[j] += alpha[r] * row[j];
+      row[j] += alpha[r] * x[j];
+    }
+  }
+}
+
+__attribute__((target("sse2"))) int64_t filterSse(
+    const real* x,
+    int64_t n,
+    real threshold,
+    int32_t* idx) {
+  const __m128 vt = _mm_set1_ps(threshold);
+  int64_t count = 0;
+  int64_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    int mask = _mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(x + i), vt));
+    while (mask) {
+      idx[count++] = i + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+  for (; i < n; i++) {
+    idx[count] = i;
+    count += x[i] >= threshold;
+  }
+  return count;
+}
+
+__attribute__((target("avx2,fma"))) real dotAvx2(
+    const real* x,
+    const real* y,
+    int64_t n) {
+  __m256 acc0 = _mm256_setzero_ps();
+  __m256 acc1 = _mm256_setzero_ps();
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), acc0);
+    acc1 = _mm256_fmadd_ps(
+        _mm256_loadu_ps(x + i + 8), _mm256_loadu_ps(y + i + 8), acc1);
+  }
+  if (i + 8 <= n) {
+    acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i), acc0);
+    i += 8;
+  }
+  acc0 = _mm256_add_ps(acc0, acc1);
+  __m128 s = _mm_add_ps(
+      _mm256_castps256_ps128(acc0), _mm256_extractf128_ps(acc0, 1));
+  s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+  s = _mm_add_ss(s, _mm_movehdup_ps(s));
+  real d = _mm_cvtss_f32(s);
+  for (; i < n; i++) {
+    d += x[i] * y[i];
+  }
+  return d;
+}
+
+__attribute__((target("avx2,fma"))) void axpyAvx2(
+    real a,
+    const real* x,
+    real* y,
+    int64_t n) {
+  const __m256 va = _mm256_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(
+        y + i,
+        _mm256_fmadd_ps(va, _mm256_loadu_ps(x + i), _mm256_loadu_ps(y + i)));
+  }
+  for (; i < n; i++) {
+    y[i] += a * x[i];
+  }
+}
+
+__attribute__((target("avx2,fma"))) void addAvx2(
+    const real* x,
+    real* y,
+    int64_t n) {
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(
+        y + i, _mm256_add_ps(_mm256_loadu_ps(y + i), _mm256_loadu_ps(x + i)));
+  }
+  for (; i < n; i++) {
+    y[i] += x[i];
+  }
+}
+
+__attribute__((target("avx2,fma"))) void scaleAvx2(
+    real a,
+    real* x,
+    int64_t n) {
+  const __m256 va = _mm256_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    _mm256_storeu_ps(x + i, _mm256_mul_ps(va, _mm256_loadu_ps(x + i)));
+  }
+  for (; i < n; i++) {
+    x[i] *= a;
+  }
+}
+
+__attribute__((target("avx2,fma"))) void gemvAvx2(
+    const real* a,
+    const int32_t* rows,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    real* y) {
+  int64_t r = 0;
+  for (; r + GEMV_ROWS <= m; r += GEMV_ROWS) {
+    const real* row[GEMV_ROWS];
+    __m256 acc0[GEMV_ROWS], acc1[GEMV_ROWS];
+    for (int k = 0; k < GEMV_ROWS; k++) {
+      row[k] = a + (rows ? rows[r + k] : r + k) * n;
+      acc0[k] = _mm256_setzero_ps();
+      acc1[k] = _mm256_setzero_ps();
+    }
+    int64_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+      const __m256 x0 = _mm256_loadu_ps(x + i);
+      const __m256 x1 = _mm256_loadu_ps(x + i + 8);
+      for (int k = 0; k < GEMV_ROWS; k++) {
+        acc0[k] = _mm256_fmadd_ps(_mm256_loadu_ps(row[k] + i), x0, acc0[k]);
+        acc1[k] = _mm256_fmadd_ps(_mm256_loadu_ps(row[k] + i + 8), x1, acc1[k]);
+      }
+    }
+    if (i + 8 <= n) {
+      const __m256 x0 = _mm256_loadu_ps(x + i);
+      for (int k = 0; k < GEMV_ROWS; k++) {
+        acc0[k] = _mm256_fmadd_ps(_mm256_loadu_ps(row[k] + i), x0, acc0[k]);
+      }
+      i += 8;
+    }
+    for (int k = 0; k < GEMV_ROWS; k++) {
+      const __m256 v = _mm256_add_ps(acc0[k], acc1[k]);
+      __m128 s = _mm_add_ps(
+          _mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+      s = _mm_add_ps(s, _mm_movehl_ps(s, s));
+      s = _mm_add_ss(s, _mm_movehdup_ps(s));
+      real d = _mm_cvtss_f32(s);
+      for (int64_t j = i; j < n; j++) {
+        d += row[k][j] * x[j];
+      }
+      y[r + k] = d;
+    }
+  }
+  for (; r < m; r++) {
+    y[r] = dotAvx2(a + (rows ? rows[r] : r) * n, x, n);
+  }
+}
+
+__attribute__((target("avx2,fma"))) void updateRowsAvx2(
+    real* a,
+    const int32_t* rows,
+    const real* alpha,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    real* y) {
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const __m256 vx = _mm256_loadu_ps(x + i);
+    __m256 vy = _mm256_loadu_ps(y + i);
+    for (int64_t r = 0; r < m; r++) {
+      real* row = a + rows[r] * n + i;
+      const __m256 va = _mm256_set1_ps(alpha[r]);
+      const __m256 w = _mm256_loadu_ps(row);
+      vy = _mm256_fmadd_ps(va, w, vy);
+      _mm256_storeu_ps(row, _mm256_fmadd_ps(va, vx, w));
+    }
+    _mm256_storeu_ps(y + i, vy);
+  }
+  for (int64_t r = 0; r < m; r++) {
+    real* row = a + rows[r] * n;
+    for (int64_t j = i; j < n; j++) {
+      y[j] += alpha[r] * row[j];
+      row[j] += alpha[r] * x[j];
+    }
+  }
+}
+
+__attribute__((target("avx2,fma"))) int64_t filterAvx2(
+    const real* x,
+    int64_t n,
+    real threshold,
+    int32_t* idx) {
+  const __m256 vt = _mm256_set1_ps(threshold);
+  int64_t count = 0;
+  int64_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    int mask = _mm256_movemask_ps(
+        _mm256_cmp_ps(_mm256_loadu_ps(x + i), vt, _CMP_GE_OQ));
+    while (mask) {
+      idx[count++] = i + __builtin_ctz(mask);
+      mask &= mask - 1;
+    }
+  }
+  for (; i < n; i++) {
+    idx[count] = i;
+    count += x[i] >= threshold;
+  }
+  return count;
+}
+
+// The AVX-512 kernels handle the tail with masked loads and stores, so no
+// scalar loop is needed for dimensions that are not a multiple of 16.
+__attribute__((target("avx512f"))) inline __mmask16 tailMask(int64_t r) {
+  return (__mmask16)((1u << r) - 1);
+}
+
+__attribute__((target("avx512f"))) real dotAvx512(
+    const real* x,
+    const real* y,
+    int64_t n) {
+  __m512 acc0 = _mm512_setzero_ps();
+  __m512 acc1 = _mm512_setzero_ps();
+  int64_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), acc0);
+    acc1 = _mm512_fmadd_ps(
+        _mm512_loadu_ps(x + i + 16), _mm512_loadu_ps(y + i + 16), acc1);
+  }
+  if (i + 16 <= n) {
+    acc0 = _mm512_fmadd_ps(_mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i), acc0);
+    i += 16;
+  }
+  if (i < n) {
+    const __mmask16 m = tailMask(n - i);
+    acc1 = _mm512_fmadd_ps(
+        _mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, y + i), acc1);
+  }
+  return _mm512_reduce_add_ps(_mm512_add_ps(acc0, acc1));
+}
+
+__attribute__((target("avx512f"))) void axpyAvx512(
+    real a,
+    const real* x,
+    real* y,
+    int64_t n) {
+  const __m512 va = _mm512_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(
+        y + i,
+        _mm512_fmadd_ps(va, _mm512_loadu_ps(x + i), _mm512_loadu_ps(y + i)));
+  }
+  if (i < n) {
+    const __mmask16 m = tailMask(n - i);
+    _mm512_mask_storeu_ps(
+        y + i,
+        m,
+        _mm512_fmadd_ps(
+            va, _mm512_maskz_loadu_ps(m, x + i), _mm512_maskz_loadu_ps(m, y + i)));
+  }
+}
+
+__attribute__((target("avx512f"))) void addAvx512(
+    const real* x,
+    real* y,
+    int64_t n) {
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(
+        y + i, _mm512_add_ps(_mm512_loadu_ps(y + i), _mm512_loadu_ps(x + i)));
+  }
+  if (i < n) {
+    const __mmask16 m = tailMask(n - i);
+    _mm512_mask_storeu_ps(
+        y + i,
+        m,
+        _mm512_add_ps(
+            _mm512_maskz_loadu_ps(m, y + i), _mm512_maskz_loadu_ps(m, x + i)));
+  }
+}
+
+__attribute__((target("avx512f"))) void scaleAvx512(
+    real a,
+    real* x,
+    int64_t n) {
+  const __m512 va = _mm512_set1_ps(a);
+  int64_t i = 0;
+  for (; i + 16 <= n; i += 16) {
+    _mm512_storeu_ps(x + i, _mm512_mul_ps(va, _mm512_loadu_ps(x + i)));
+  }
+  if (i < n) {
+    const __mmask16 m = tailMask(n - i);
+    _mm512_mask_storeu_ps(
+        x + i, m, _mm512_mul_ps(va, _mm512_maskz_loadu_ps(m, x + i)));
+  }
+}
+
+__attribute__((target("avx512f"))) void gemvAvx512(
+    const real* a,
+    const int32_t* rows,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    real* y) {
+  int64_t r = 0;
+  for (; r + GEMV_ROWS <= m; r += GEMV_ROWS) {
+    const real* row[GEMV_ROWS];
+    __m512 acc0[GEMV_ROWS], acc1[GEMV_ROWS];
+    for (int k = 0; k < GEMV_ROWS; k++) {
+      row[k] = a + (rows ? rows[r + k] : r + k) * n;
+      acc0[k] = _mm512_setzero_ps();
+      acc1[k] = _mm512_setzero_ps();
+    }
+    int64_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+      const __m512 x0 = _mm512_loadu_ps(x + i);
+      const __m512 x1 = _mm512_loadu_ps(x + i + 16);
+      for (int k = 0; k < GEMV_ROWS; k++) {
+        acc0[k] = _mm512_fmadd_ps(_mm512_loadu_ps(row[k] + i), x0, acc0[k]);
+        acc1[k] =
+            _mm512_fmadd_ps(_mm512_loadu_ps(row[k] + i + 16), x1, acc1[k]);
+      }
+    }
+    if (i + 16 <= n) {
+      const __m512 x0 = _mm512_loadu_ps(x + i);
+      for (int k = 0; k < GEMV_ROWS; k++) {
+        acc0[k] = _mm512_fmadd_ps(_mm512_loadu_ps(row[k] + i), x0, acc0[k]);
+      }
+      i += 16;
+    }
+    if (i < n) {
+      const __mmask16 mask = tailMask(n - i);
+      const __m512 x1 = _mm512_maskz_loadu_ps(mask, x + i);
+      for (int k = 0; k < GEMV_ROWS; k++) {
+        acc1[k] = _mm512_fmadd_ps(
+            _mm512_maskz_loadu_ps(mask, row[k] + i), x1, acc1[k]);
+      }
+    }
+    for (int k = 0; k < GEMV_ROWS; k++) {
+      y[r + k] = _mm512_reduce_add_ps(_mm512_add_ps(acc0[k], acc1[k]));
+    }
+  }
+  for (; r < m; r++) {
+    y[r] = dotAvx512(a + (rows ? rows[r] : r) * n, x, n);
+  }
+}
+
+__attribute__((target("avx512f"))) void updateRowsAvx512(
+    real* a,
+    const int32_t* rows,
+    const real* alpha,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    real* y) {
+  for (int64_t i = 0; i < n; i += 16) {
+    const __mmask16 mask = i + 16 <= n ? 0xFFFF : tailMask(n - i);
+    const __m512 vx = _mm512_maskz_loadu_ps(mask, x + i);
+    __m512 vy = _mm512_maskz_loadu_ps(mask, y + i);
+    for (int64_t r = 0; r < m; r++) {
+      real* row = a + rows[r] * n + i;
+      const __m512 va = _mm512_set1_ps(alpha[r]);
+      const __m512 w = _mm512_maskz_loadu_ps(mask, row);
+      vy = _mm512_fmadd_ps(va, w, vy);
+      _mm512_mask_storeu_ps(row, mask, _mm512_fmadd_ps(va, vx, w));
+    }
+    _mm512_mask_storeu_ps(y + i, mask, vy);
+  }
+}
+
+__attribute__((target("avx512f"))) int64_t filterAvx512(
+    const real* x,
+    int64_t n,
+    real threshold,
+    int32_t* idx) {
+  const __m512 vt = _mm512_set1_ps(threshold);
+  const __m512i step = _mm512_set1_epi32(16);
+  __m512i indices = _mm512_setr_epi32(
+      0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  int64_t count = 0;
+  int64_t i = 0;
+  for (; i < n; i += 16) {
+    const __mmask16 valid = i + 16 <= n ? 0xFFFF : tailMask(n - i);
+    const __mmask16 mask = _mm512_mask_cmp_ps_mask(
+        valid, _mm512_maskz_loadu_ps(valid, x + i), vt, _CMP_GE_OQ);
+    _mm512_mask_compressstoreu_epi32(idx + count, mask, indices);
+    count += __builtin_popcount(mask);
+    indices = _mm512_add_epi32(indices, step);
+  }
+  return count;
+}
+
+const Kernels kSse = {
+    "sse",
+    dotSse,
+    axpySse,
+    addSse,
+    scaleSse,
+    gemvSse,
+    updateRowsSse,
+    filterSse};
+const Kernels kAvx2 = {
+    "avx2",
+    dotAvx2,
+    axpyAvx2,
+    addAvx2,
+    scaleAvx2,
+    gemvAvx2,
+    updateRowsAvx2,
+    filterAvx2};
+const Kernels kAvx512 = {
+    "avx512",
+    dotAvx512,
+    axpyAvx512,
+    addAvx512,
+    scaleAvx512,
+    gemvAvx512,
+    updateRowsAvx512,
+    filterAvx512};
+
+#endif
+
+// Best first.
+std::vector<const Kernels*> supportedKernels() {
+  std::vector<const Kernels*> kernels;
+#ifdef FASTTEXT_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) {
+    kernels.push_back(&kAvx512);
+  }
+  if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+    kernels.push_back(&kAvx2);
+  }
+  if (__builtin_cpu_supports("sse2")) {
+    kernels.push_back(&kSse);
+  }
+#endif
+  kernels.push_back(&kScalar);
+  return kernels;
+}
+
+bool close(real expected, real actual, real scale) {
+  return std::abs(expected - actual) <= 1e-5 * scale + 1e-6;
+}
+
+// Runs k and the scalar kernels on the same inputs for every length up to a
+// few full vectors plus a tail, starting at unaligned addresses.
+bool check(const Kernels& k) {
+  const int64_t maxn = 67;
+  std::vector<real> x(maxn + 1), y(maxn + 1), expected(maxn + 1);
+  std::vector<real> actual(maxn + 1);
+  for (int64_t i = 0; i <= maxn; i++) {
+    x[i] = real((i * 37) % 19) / 7 - 1.25;
+    y[i] = real((i * 11) % 23) / 5 - 2.1;
+  }
+  const real* xs = x.data() + 1;
+  for (int64_t len = 0; len < maxn; len++) {
+    real scale = 0.0;
+    for (int64_t i = 0; i < len; i++) {
+      scale += std::abs(xs[i] * y[i]);
+    }
+    if (!close(dotScalar(xs, y.data(), len), k.dot(xs, y.data(), len), scale)) {
+      return false;
+    }
+
+    std::memcpy(expected.data(), y.data(), len * sizeof(real));
+    std::memcpy(actual.data(), y.data(), len * sizeof(real));
+    axpyScalar(0.75, xs, expected.data(), len);
+    k.axpy(0.75, xs, actual.data(), len);
+    addScalar(xs, expected.data(), len);
+    k.add(xs, actual.data(), len);
+    scaleScalar(-1.5, expected.data(), len);
+    k.scale(-1.5, actual.data(), len);
+    for (int64_t i = 0; i < len; i++) {
+      if (!close(expected[i], actual[i], std::abs(expected[i]))) {
+        return false;
+      }
+    }
+    // the element past the end must be left alone
+    if (actual[len] != 0.0) {
+      return false;
+    }
+  }
+
+  std::vector<int32_t> idx(maxn), expectedIdx(maxn);
+  for (int64_t len = 0; len < maxn; len++) {
+    const int64_t count = k.filter(xs, len, 0.1, idx.data());
+    if (count != filterScalar(xs, len, 0.1, expectedIdx.data()) ||
+        !std::equal(idx.begin(), idx.begin() + count, expectedIdx.begin())) {
+      return false;
+    }
+  }
+
+  // gemv must give exactly what k.dot gives for each row
+  const int64_t rows = 2 * GEMV_ROWS + 1;
+  std::vector<real> a(rows * maxn), out(rows);
+  for (int64_t i = 0; i < rows * maxn; i++) {
+    a[i] = real((i * 29) % 31) / 9 - 1.5;
+  }
+  for (int64_t len = 0; len <= maxn; len++) {
+    k.gemv(a.data(), nullptr, rows, len, y.data(), out.data());
+    for (int64_t r = 0; r < rows; r++) {
+      if (out[r] != k.dot(a.data() + r * len, y.data(), len)) {
+        return false;
+      }
+    }
+  }
+
+  // and so must gemv on rows picked by index, and updateRows must give
+  // exactly what a pair of k.axpy gives for each row, repeats included
+  const int32_t picked[rows] = {7, 2, 0, 5, 2, 8, 1, 3, 6};
+  std::vector<real> alpha(rows), b(a), grad(maxn), expectedGrad(maxn);
+  for (int64_t r = 0; r < rows; r++) {
+    alpha[r] = real(r % 5) / 4 - 0.6;
+  }
+  for (int64_t len = 0; len <= maxn; len++) {
+    k.gemv(a.data(), picked, rows, len, y.data(), out.data());
+    for (int64_t r = 0; r < rows; r++) {
+      if (out[r] != k.dot(a.data() + picked[r] * len, y.data(), len)) {
+        return false;
+      }
+    }
+    std::copy(a.begin(), a.end(), b.begin());
+    std::copy(xs, xs + len, grad.begin());
+    std::copy(xs, xs + len, expectedGrad.begin());
+    k.updateRows(
+        b.data(), picked, alpha.data(), rows, len, y.data(), grad.data());
+    for (int64_t r = 0; r < rows; r++) {
+      real* row = a.data() + picked[r] * len;
+      k.axpy(alpha[r], row, expectedGrad.data(), len);
+      k.axpy(alpha[r], y.data(), row, len);
+    }
+    if (a != b || grad != expectedGrad) {
+      return false;
+    }
+  }
+  return true;
+}
+
+const Kernels& select() {
+  const char* forced = std::getenv("FASTTEXT_SIMD");
+  for (const Kernels* k : supportedKernels()) {
+    if (forced && *forced && std::strcmp(forced, k->name) != 0) {
+      continue;
+    }
+    if (check(*k)) {
+      return *k;
+    }
+  }
+  return kScalar;
+}
+
+} // namespace
+
+const Kernels& active() {
+  static const Kernels& kernels = select();
+  return kernels;
+}
+
+void gemm(
+    const real* a,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    int64_t b,
+    real* y) {
+  const Kernels& k = active();
+  int64_t block = GEMM_BLOCK_BYTES / sizeof(real) / std::max(n, int64_t(1));
+  block = std::max(block / GEMV_ROWS * GEMV_ROWS, int64_t(GEMV_ROWS));
+  for (int64_t r = 0; r < m; r += block) {
+    const int64_t rows = std::min(block, m - r);
+    for (int64_t j = 0; j < b; j++) {
+      k.gemv(a + r * n, nullptr, rows, n, x + j * n, y + j * m + r);
+    }
+  }
+}
+
+bool selfTest() {
+  for (const Kernels* k : supportedKernels()) {
+    if (!check(*k)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace simd
+
+} // namespace fasttext
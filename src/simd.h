@@ -0,0 +1,123 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "real.h"
+
+namespace fasttext {
+
+// Vector kernels behind DenseMatrix, MappedMatrix and Vector. Every kernel
+// is compiled for several instruction sets and the best one supported by
+// the cpu is picked at the first call, so a single binary runs everywhere.
+// Setting FASTTEXT_SIMD to avx512, avx2, sse or scalar restricts the choice.
+namespace simd {
+
+struct Kernels {
+  const char* name;
+  real (*dot)(const real* x, const real* y, int64_t n);
+  void (*axpy)(real a, const real* x, real* y, int64_t n);
+  void (*add)(const real* x, real* y, int64_t n);
+  void (*scale)(real a, real* x, int64_t n);
+  void (*gemv)(
+      const real* a,
+      const int32_t* rows,
+      int64_t m,
+      int64_t n,
+      const real* x,
+      real* y);
+  void (*updateRows)(
+      real* a,
+      const int32_t* rows,
+      const real* alpha,
+      int64_t m,
+      int64_t n,
+      const real* x,
+      real* y);
+  int64_t (*filter)(const real* x, int64_t n, real threshold, int32_t* idx);
+};
+
+const Kernels& active();
+
+// Compares the kernels of every instruction set this cpu supports against
+// the scalar ones. Dispatch only picks kernels that pass.
+bool selfTest();
+
+// Returns sum_i x[i] * y[i].
+inline real dot(const real* x, const real* y, int64_t n) {
+  return active().dot(x, y, n);
+}
+
+// y += a * x
+inline void axpy(real a, const real* x, real* y, int64_t n) {
+  active().axpy(a, x, y, n);
+}
+
+// y += x
+inline void add(const real* x, real* y, int64_t n) {
+  active().add(x, y, n);
+}
+
+// x *= a
+inline void scale(real a, real* x, int64_t n) {
+  active().scale(a, x, n);
+}
+
+// y = A x, where A is the row-major m x n matrix at a.
+inline void gemv(const real* a, int64_t m, int64_t n, const real* x, real* y) {
+  active().gemv(a, nullptr, m, n, x, y);
+}
+
+// y[r] = A[rows[r]] x for r < m, where A is the row-major matrix at a with
+// rows of length n. Each value is exactly what dot computes.
+inline void dotRows(
+    const real* a,
+    const int32_t* rows,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    real* y) {
+  active().gemv(a, rows, m, n, x, y);
+}
+
+// For r < m in order: y += alpha[r] * A[rows[r]], then
+// A[rows[r]] += alpha[r] * x. The values are exactly those of two axpy
+// calls per row, but y is read and written once for all the rows.
+inline void updateRows(
+    real* a,
+    const int32_t* rows,
+    const real* alpha,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    real* y) {
+  active().updateRows(a, rows, alpha, m, n, x, y);
+}
+
+// Writes the indices i with x[i] >= threshold to idx, in increasing order,
+// and returns how many there are. idx must have room for n entries.
+inline int64_t filter(const real* x, int64_t n, real threshold, int32_t* idx) {
+  return active().filter(x, n, threshold, idx);
+}
+
+// y = X A^T, where X is the row-major b x n matrix at x and y is b x m.
+// Runs gemv over blocks of rows of A that fit in cache, so A is read from
+// memory once for all of X instead of once per row of X.
+void gemm(
+    const real* a,
+    int64_t m,
+    int64_t n,
+    const real* x,
+    int64_t b,
+    real* y);
+
+} // namespace simd
+
+} // namespace fasttext
@@ -0,0 +1,152 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "tokenizer.h"
+
+#include <algorithm>
+
+namespace fasttext {
+
+namespace {
+
+const char EOS[] = "</s>";
+const size_t EOS_SIZE = sizeof(EOS) - 1;
+
+struct Delimiters {
+  bool table[256];
+
+  Delimiters() : table() {
+    for (unsigned char c : {' ', '\n', '\r', '\t', '\v', '\f', '\0'}) {
+      table[c] = true;
+    }
+  }
+};
+
+const Delimiters delimiters;
+
+inline bool isDelimiter(char c) {
+  return delimiters.table[static_cast<unsigned char>(c)];
+}
+
+uint32_t eosHash() {
+  uint32_t h = FNV_OFFSET;
+  for (size_t i = 0; i < EOS_SIZE; i++) {
+    h = fnvStep(h, EOS[i]);
+  }
+  return h;
+}
+
+const uint32_t EOS_HASH = eosHash();
+
+} // namespace
+
+Tokenizer::Tokenizer(std::istream& in, int64_t limit)
+    : in_(in),
+      block_(BLOCK_SIZE),
+      eof_(false),
+      exhausted_(false),
+      limit_(limit),
+      remaining_(limit) {
+  pos_ = end_ = block_.data();
+}
+
+bool Tokenizer::fill() {
+  pos_ = end_ = block_.data();
+  if (eof_) {
+    return false;
+  }
+  const int64_t size =
+      remaining_ < 0 ? BLOCK_SIZE : std::min(int64_t(BLOCK_SIZE), remaining_);
+  in_.read(block_.data(), size);
+  const int64_t n = in_.gcount();
+  if (remaining_ >= 0) {
+    remaining_ -= n;
+  }
+  eof_ = n < size || remaining_ == 0;
+  end_ = pos_ + n;
+  return n > 0;
+}
+
+int64_t Tokenizer::boundary(std::istream& in, int64_t pos) {
+  in.clear();
+  in.seekg(std::streampos(pos));
+  std::streambuf& sb = *in.rdbuf();
+  int c;
+  while ((c = sb.sbumpc()) != EOF && !isDelimiter(char(c))) {
+    pos++;
+  }
+  return pos;
+}
+
+bool Tokenizer::next(const char*& token, size_t& size, uint32_t& hash) {
+  while (true) {
+    if (pos_ == end_ && !fill()) {
+      exhausted_ = true;
+      return false;
+    }
+    const char c = *pos_;
+    if (!isDelimiter(c)) {
+      break;
+    }
+    pos_++;
+    if (c == '\n') {
+      token = EOS;
+      size = EOS_SIZE;
+      hash = EOS_HASH;
+      return true;
+    }
+  }
+  uint32_t h = FNV_OFFSET;
+  const char* begin = pos_;
+  bool straddles = false;
+  while (true) {
+    while (pos_ < end_ && !isDelimiter(*pos_)) {
+      h = fnvStep(h, *pos_);
+      pos_++;
+    }
+    if (pos_ < end_) {
+      break;
+    }
+    if (!straddles) {
+      token_.clear();
+      straddles = true;
+    }
+    token_.append(begin, pos_);
+    const bool more = fill();
+    begin = pos_;
+    if (!more) {
+      exhausted_ = true;
+      break;
+    }
+  }
+  if (straddles) {
+    token_.append(begin, pos_);
+    token = token_.data();
+    size = token_.size();
+  } else {
+    token = begin;
+    size = pos_ - begin;
+  }
+  hash = h;
+  return true;
+}
+
+bool Tokenizer::eof() const {
+  return exhausted_;
+}
+
+void Tokenizer::rewind() {
+  in_.clear();
+  in_.seekg(std::streampos(0));
+  eof_ = false;
+  exhausted_ = false;
+  remaining_ = limit_;
+  pos_ = end_ = block_.data();
+}
+
+} // namespace fasttext
@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+namespace fasttext {
+
+const uint32_t FNV_OFFSET = 2166136261u;
+
+// One byte of the 32-bit FNV-1a hash used for words. Bytes are sign
+// extended, as they always have been, so that models keep their hashes.
+inline uint32_t fnvStep(uint32_t h, char c) {
+  return (h ^ uint32_t(int8_t(c))) * 16777619u;
+}
+
+// Splits a stream into the tokens of Dictionary::readWord: runs of bytes
+// other than whitespace and NUL, plus "</s>" for every newline. The stream
+// is read in blocks and every token is a pointer into the block, valid
+// until the next call, with its hash computed in the same pass that finds
+// its end. Reads ahead of the last token returned, so the stream should
+// only be used through the tokenizer while it is alive.
+class Tokenizer {
+ protected:
+  static const int64_t BLOCK_SIZE = 1 << 16;
+
+  std::istream& in_;
+  std::vector<char> block_;
+  const char* pos_;
+  const char* end_;
+  bool eof_;
+  bool exhausted_;
+  const int64_t limit_;
+  int64_t remaining_;
+  // Holds the tokens that straddle two blocks.
+  std::string token_;
+
+  bool fill();
+
+ public:
+  // Reads at most limit bytes from the current position of the stream,
+  // or up to its end if limit is negative.
+  explicit Tokenizer(std::istream& in, int64_t limit = -1);
+  Tokenizer(const Tokenizer&) = delete;
+  Tokenizer& operator=(const Tokenizer&) = delete;
+
+  // Returns false once the stream has no more tokens.
+  bool next(const char*& token, size_t& size, uint32_t& hash);
+  // Whether a call to next() ran into the end of the stream, which is when
+  // Dictionary::readWord would have set the eof bit.
+  bool eof() const;
+  // Goes back to the start of the stream.
+  void rewind();
+
+  // Returns the offset of the first delimiter at or after pos, or the size
+  // of the stream, so that tokenizing a file from there gives the same
+  // tokens as tokenizing it from the start.
+  static int64_t boundary(std::istream& in, int64_t pos);
+};
+
+} // namespace fasttext
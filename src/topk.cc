@@ -0,0 +1,67 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#include "topk.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+#include "simd.h"
+
+namespace fasttext {
+
+// x is split into rows of m entries and maxima_[j] is the largest x[r * m + j]
+// over the rows. These are m distinct entries of x, so at least k entries
+// are >= the k-th largest of them. A few times k maxima are enough to make
+// the bound tight while keeping nth_element on them cheap.
+real TopK::lowerBound(const real* x, int64_t n, int32_t k) {
+  const int64_t m = std::min(
+      n / MIN_ROWS,
+      std::max(int64_t(k) * MAXIMA_PER_RESULT, int64_t(MIN_MAXIMA)));
+  if (m <= k) {
+    return -std::numeric_limits<real>::infinity();
+  }
+  maxima_.assign(x, x + m);
+  for (int64_t r = 1; r < n / m; r++) {
+    const real* row = x + r * m;
+    for (int64_t j = 0; j < m; j++) {
+      maxima_[j] = std::max(maxima_[j], row[j]);
+    }
+  }
+  std::nth_element(
+      maxima_.begin(),
+      maxima_.begin() + k - 1,
+      maxima_.end(),
+      std::greater<real>());
+  return maxima_[k - 1];
+}
+
+const std::vector<int32_t>&
+TopK::select(const real* x, int64_t n, int32_t k, real threshold) {
+  if (int64_t(candidates_.size()) < n) {
+    candidates_.resize(n);
+  }
+  threshold = std::max(threshold, lowerBound(x, n, k));
+  const int64_t count = simd::filter(x, n, threshold, candidates_.data());
+
+  auto better = [x](int32_t a, int32_t b) {
+    return x[a] > x[b] || (x[a] == x[b] && a > b);
+  };
+  auto first = candidates_.begin();
+  auto last = first + count;
+  if (count > k) {
+    std::nth_element(first, first + k - 1, last, better);
+    last = first + k;
+  }
+  indices_.assign(first, last);
+  std::sort(indices_.begin(), indices_.end(), better);
+  return indices_;
+}
+
+} // namespace fasttext
@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) 2016-present, Facebook, Inc.
+ * All rights reserved.
+ *
+ * This source code is licensed under the MIT license found in the
+ * LICENSE file in the root directory of this source tree.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "real.h"
+
+namespace fasttext {
+
+// Selects the largest entries of a score vector. Column maxima of the
+// vector seen as a matrix give a lower bound on the k-th largest score, so
+// only a handful of entries pass the vectorized threshold filter and reach
+// nth_element. The buffers are kept between calls.
+class TopK {
+ protected:
+  static const int64_t MIN_ROWS = 16;
+  static const int64_t MIN_MAXIMA = 1024;
+  static const int64_t MAXIMA_PER_RESULT = 64;
+
+  std::vector<real> maxima_;
+  // Only grows, so that it is not cleared again on every call.
+  std::vector<int32_t> candidates_;
+  std::vector<int32_t> indices_;
+
+  real lowerBound(const real* x, int64_t n, int32_t k);
+
+ public:
+  // Returns the indices of the k largest x[i] >= threshold, best first.
+  // Among equal scores the higher index comes first, as the last of them
+  // is the one a heap based selection keeps for k = 1.
+  const std::vector<int32_t>&
+  select(const real* x, int64_t n, int32_t k, real threshold);
+};
+
+} // namespace fasttext
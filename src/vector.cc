@@ -15,6 +15,7 @@
 #include <utility>
 
 #include "matrix.h"
+#include "simd.h"
 
 namespace fasttext {
 
@@ -25,31 +26,21 @@ void Vector::zero() {
 }
 
 real Vector::norm() const {
-  real sum = 0;
-  for (int64_t i = 0; i < size(); i++) {
-    sum += data_[i] * data_[i];
-  }
-  return std::sqrt(sum);
+  return std::sqrt(simd::dot(data(), data(), size()));
 }
 
 void Vector::mul(real a) {
-  for (int64_t i = 0; i < size(); i++) {
-    data_[i] *= a;
-  }
+  simd::scale(a, data(), size());
 }
 
 void Vector::addVector(const Vector& source) {
   assert(size() == source.size());
-  for (int64_t i = 0; i < size(); i++) {
-    data_[i] += source.data_[i];
-  }
+  simd::add(source.data(), data(), size());
 }
 
 void Vector::addVector(const Vector& source, real s) {
   assert(size() == source.size());
-  for (int64_t i = 0; i < size(); i++) {
-    data_[i] += s * source.data_[i];
-  }
+  simd::axpy(s, source.data(), data(), size());
 }
 
 void Vector::addRow(const Matrix& A, int64_t i, real a) {
@@ -69,9 +60,7 @@ void Vector::addRow(const Matrix& A, int64_t i) {
 void Vector::mul(const Matrix& A, const Vector& vec) {
   assert(A.size(0) == size());
   assert(A.size(1) == vec.size());
-  for (int64_t i = 0; i < size(); i++) {
-    data_[i] = A.dotRow(vec, i);
-  }
+  A.gemv(vec, *this);
 }
 
 int64_t Vector::argmax() {